@@ -0,0 +1,104 @@
+#include "aioqueue.h"
+
+using namespace std;
+using namespace chrono;
+using namespace librados;
+
+AioQueue::AioQueue(size_t depth) : slots(depth), inflight(0) {
+    for (size_t i = 0; i < depth; i++) {
+        slots[i].queue = this;
+        slots[i].index = i;
+        slots[i].completion = nullptr;
+        free_slots.push_back(depth - 1 - i);
+    }
+}
+
+AioQueue::~AioQueue() {
+    // Callbacks point into `slots`, so nothing may outlive them.
+    drain();
+}
+
+void AioQueue::submit(const issue_fn &issue, unsigned tag, steady_clock::time_point intended) {
+    if (free_slots.empty())
+        throw "AIO queue overflow";
+
+    auto &slot = slots[free_slots.back()];
+    slot.tag = tag;
+    slot.data.clear();
+    slot.completion = Rados::aio_create_completion();
+    slot.completion->set_complete_callback(&slot, complete_cb);
+    slot.submitted = steady_clock::now();
+    slot.intended = intended == steady_clock::time_point() ? slot.submitted : intended;
+
+    int err;
+    if ((err = issue(slot.completion, &slot.data)) < 0) {
+        slot.completion->release();
+        slot.completion = nullptr;
+        throw "Failed to submit aio";
+    }
+    free_slots.pop_back();
+    inflight++;
+}
+
+void AioQueue::complete_cb(completion_t, void *arg) {
+    auto slot = static_cast<Slot *>(arg);
+    slot->completed = steady_clock::now();
+
+    auto queue = slot->queue;
+    lock_guard <mutex> guard(queue->lock);
+    queue->done.push_back(slot->index);
+    queue->cond.notify_one();
+}
+
+AioResult AioQueue::wait() {
+    if (!inflight)
+        throw "Waiting on empty AIO queue";
+
+    size_t index;
+    {
+        unique_lock <mutex> guard(lock);
+        cond.wait(guard, [this] { return !done.empty(); });
+        index = done.front();
+        done.pop_front();
+    }
+    return reap(index);
+}
+
+bool AioQueue::wait_until(steady_clock::time_point deadline, AioResult &res) {
+    if (!inflight)
+        throw "Waiting on empty AIO queue";
+
+    size_t index;
+    {
+        unique_lock <mutex> guard(lock);
+        if (!cond.wait_until(guard, deadline, [this] { return !done.empty(); }))
+            return false;
+        index = done.front();
+        done.pop_front();
+    }
+    res = reap(index);
+    return true;
+}
+
+AioResult AioQueue::reap(size_t index) {
+    auto &slot = slots[index];
+    // wait_for_complete() also orders us after the callback's writes.
+    slot.completion->wait_for_complete();
+    AioResult res;
+    res.ret = slot.completion->get_return_value();
+    res.tag = slot.tag;
+    res.submitted = slot.submitted;
+    res.intended = slot.intended;
+    res.latency = slot.completed - slot.submitted;
+    slot.completion->release();
+    slot.completion = nullptr;
+
+    free_slots.push_back(index);
+    inflight--;
+    return res;
+}
+
+void AioQueue::drain() {
+    while (inflight)
+        wait();
+}
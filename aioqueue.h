@@ -0,0 +1,74 @@
+#ifndef AIOQUEUE_H
+#define AIOQUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <librados.hpp>
+
+struct AioResult {
+    int ret;
+    unsigned tag;
+    std::chrono::steady_clock::time_point submitted;
+    std::chrono::steady_clock::time_point intended;
+    std::chrono::steady_clock::duration latency;
+};
+
+// Keeps up to `depth` librados aio ops in flight for a single bench thread.
+// Finished ops are handed back in completion order, with the latency measured
+// from submission to the librados completion callback.
+class AioQueue {
+public:
+    // Starts one aio op on the given completion, returns librados error code.
+    typedef std::function<int(librados::AioCompletion *, librados::bufferlist *)> issue_fn;
+
+    explicit AioQueue(size_t depth);
+
+    ~AioQueue();
+
+    bool full() const { return inflight == slots.size(); }
+
+    size_t pending() const { return inflight; }
+
+    // `intended` is when the op was scheduled to go out, if it runs late
+    // because the queue was full; it defaults to the actual submit time.
+    void submit(const issue_fn &issue, unsigned tag = 0,
+                std::chrono::steady_clock::time_point intended = std::chrono::steady_clock::time_point());
+
+    // Blocks until some op finishes.
+    AioResult wait();
+
+    // Like wait(), but gives up at `deadline` and returns false.
+    bool wait_until(std::chrono::steady_clock::time_point deadline, AioResult &res);
+
+    void drain();
+
+private:
+    struct Slot {
+        AioQueue *queue;
+        size_t index;
+        unsigned tag;
+        librados::AioCompletion *completion;
+        librados::bufferlist data;
+        std::chrono::steady_clock::time_point submitted;
+        std::chrono::steady_clock::time_point intended;
+        std::chrono::steady_clock::time_point completed;
+    };
+
+    static void complete_cb(librados::completion_t, void *arg);
+
+    AioResult reap(size_t index);
+
+    std::vector <Slot> slots;
+    std::vector <size_t> free_slots;
+    size_t inflight;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque <size_t> done;
+};
+
+#endif
@@ -0,0 +1,213 @@
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+#include "generators.h"
+
+using namespace std;
+
+static uint64_t splitmix64(uint64_t &x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+Rng::Rng(uint64_t seed) {
+    for (auto &v : s)
+        v = splitmix64(seed);
+}
+
+uint64_t Rng::next() {
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+uint64_t Rng::below(uint64_t n) {
+    // Lemire's multiply-shift; the bias is negligible for our ranges.
+    return (uint64_t) (((unsigned __int128) next() * n) >> 64);
+}
+
+double Rng::unit() {
+    return (next() >> 11) * (1.0 / (1ULL << 53));
+}
+
+AccessPattern AccessPattern::parse(const string &spec) {
+    AccessPattern p;
+    unsigned long long step;
+    double a, b;
+
+    if (spec == "uniform") {
+        p.kind = UNIFORM;
+    } else if (spec == "seq") {
+        p.kind = SEQUENTIAL;
+    } else if (sscanf(spec.c_str(), "stride:%llu", &step) == 1) {
+        if (step < 1)
+            throw "Stride must be at least 1";
+        p.kind = STRIDED;
+        p.stride = step;
+    } else if (sscanf(spec.c_str(), "zipf:%lf", &a) == 1) {
+        if (!(a > 0 && a < 1))
+            throw "Zipfian theta must be in (0, 1)";
+        p.kind = ZIPFIAN;
+        p.theta = a;
+    } else if (sscanf(spec.c_str(), "hotspot:%lf:%lf", &a, &b) == 2) {
+        if (!(a > 0 && a < 100 && b >= 0 && b <= 100))
+            throw "Hotspot percentages out of range";
+        p.kind = HOTSPOT;
+        p.hot_space = a / 100;
+        p.hot_ops = b / 100;
+    } else {
+        throw "Wrong access pattern";
+    }
+    return p;
+}
+
+string AccessPattern::describe() const {
+    ostringstream out;
+    switch (kind) {
+        case UNIFORM:
+            out << "uniform";
+            break;
+        case SEQUENTIAL:
+            out << "seq";
+            break;
+        case STRIDED:
+            out << "stride:" << stride;
+            break;
+        case ZIPFIAN:
+            out << "zipf:" << theta;
+            break;
+        case HOTSPOT:
+            out << "hotspot:" << hot_space * 100 << ":" << hot_ops * 100;
+            break;
+    }
+    return out.str();
+}
+
+namespace {
+
+class UniformGenerator : public IndexGenerator {
+public:
+    explicit UniformGenerator(uint64_t n_) : n(n_) {}
+
+    uint64_t next(Rng &rng) override { return rng.below(n); }
+
+private:
+    uint64_t n;
+};
+
+// Walks 0, step, 2*step, ... then 1, 1+step, ... so that every index is
+// visited once per pass. A step of 1 is plain sequential access.
+class StridedGenerator : public IndexGenerator {
+public:
+    StridedGenerator(uint64_t n_, uint64_t stride_)
+            : n(n_), stride(stride_ < n_ ? stride_ : 1), lap(0), pos(0) {}
+
+    uint64_t next(Rng &) override {
+        const uint64_t res = pos;
+        pos += stride;
+        if (pos >= n) {
+            lap = (lap + 1) % stride;
+            pos = lap;
+        }
+        return res;
+    }
+
+private:
+    uint64_t n;
+    uint64_t stride;
+    uint64_t lap;
+    uint64_t pos;
+};
+
+// Gray et al., "Quickly generating billion-record synthetic databases", as
+// used by YCSB. Index i is the (i+1)-th most popular one.
+class ZipfianGenerator : public IndexGenerator {
+public:
+    ZipfianGenerator(uint64_t n_, double theta_) : n(n_), theta(theta_) {
+        zetan = 0;
+        for (uint64_t i = 1; i <= n; i++)
+            zetan += 1.0 / pow(i, theta);
+        const double zeta2 = 1.0 + 1.0 / pow(2, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+        half_pow_theta = 1.0 + pow(0.5, theta);
+    }
+
+    uint64_t next(Rng &rng) override {
+        const double u = rng.unit();
+        const double uz = u * zetan;
+        if (uz < 1.0 || n < 2)
+            return 0;
+        if (uz < half_pow_theta)
+            return 1;
+        const uint64_t res = (uint64_t) (n * pow(eta * u - eta + 1.0, alpha));
+        return res < n ? res : n - 1;
+    }
+
+private:
+    uint64_t n;
+    double theta;
+    double zetan;
+    double alpha;
+    double eta;
+    double half_pow_theta;
+};
+
+// The first hot_space of the indexes receive hot_ops of the picks.
+class HotspotGenerator : public IndexGenerator {
+public:
+    HotspotGenerator(uint64_t n_, double hot_space, double hot_ops_) : n(n_), hot_ops(hot_ops_) {
+        hot = (uint64_t) ceil(n * hot_space);
+        if (hot < 1)
+            hot = 1;
+        if (hot > n)
+            hot = n;
+    }
+
+    uint64_t next(Rng &rng) override {
+        if (hot == n || rng.unit() < hot_ops)
+            return rng.below(hot);
+        return hot + rng.below(n - hot);
+    }
+
+private:
+    uint64_t n;
+    uint64_t hot;
+    double hot_ops;
+};
+
+} // namespace
+
+unique_ptr<IndexGenerator> IndexGenerator::create(const AccessPattern &pattern, uint64_t n) {
+    if (!n)
+        throw "Empty index range";
+
+    switch (pattern.kind) {
+        case AccessPattern::SEQUENTIAL:
+            return unique_ptr<IndexGenerator>(new StridedGenerator(n, 1));
+        case AccessPattern::STRIDED:
+            return unique_ptr<IndexGenerator>(new StridedGenerator(n, pattern.stride));
+        case AccessPattern::ZIPFIAN:
+            return unique_ptr<IndexGenerator>(new ZipfianGenerator(n, pattern.theta));
+        case AccessPattern::HOTSPOT:
+            return unique_ptr<IndexGenerator>(new HotspotGenerator(n, pattern.hot_space, pattern.hot_ops));
+        case AccessPattern::UNIFORM:
+        default:
+            return unique_ptr<IndexGenerator>(new UniformGenerator(n));
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef GENERATORS_H
+#define GENERATORS_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Per-thread xoshiro256** generator, seeded through splitmix64. Unlike rand()
+// it takes no lock and the same seed always yields the same op sequence.
+class Rng {
+public:
+    explicit Rng(uint64_t seed);
+
+    uint64_t next();
+
+    // Uniform in [0, n).
+    uint64_t below(uint64_t n);
+
+    // Uniform in [0, 1).
+    double unit();
+
+private:
+    uint64_t s[4];
+};
+
+// Parsed --obj-dist/--off-dist argument:
+//   uniform | seq | stride:<step> | zipf:<theta> | hotspot:<space%>:<ops%>
+struct AccessPattern {
+    enum Kind {
+        UNIFORM,
+        SEQUENTIAL,
+        STRIDED,
+        ZIPFIAN,
+        HOTSPOT
+    };
+
+    Kind kind;
+    uint64_t stride;
+    double theta;
+    double hot_space; // fraction of indexes that are hot
+    double hot_ops;   // fraction of picks that go to them
+
+    AccessPattern() : kind(UNIFORM), stride(1), theta(0.99), hot_space(0.2), hot_ops(0.8) {}
+
+    static AccessPattern parse(const std::string &spec);
+
+    std::string describe() const;
+};
+
+// Picks indexes in [0, n) following an AccessPattern.
+class IndexGenerator {
+public:
+    virtual ~IndexGenerator() {}
+
+    virtual uint64_t next(Rng &rng) = 0;
+
+    static std::unique_ptr<IndexGenerator> create(const AccessPattern &pattern, uint64_t n);
+};
+
+#endif
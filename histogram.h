@@ -0,0 +1,146 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Log-linear latency histogram over nanoseconds, laid out like HdrHistogram:
+// values below 2^SUB_BITS get a bucket each, every higher power of two is
+// split into 2^(SUB_BITS-1) equal buckets, so any recorded value is known to
+// within 1/64 of itself. Recording is O(1) and the bucket array never grows,
+// so histograms of different threads can be merged bucket by bucket.
+class LatencyHistogram {
+public:
+    static const unsigned SUB_BITS = 7;
+    static const size_t HALF = size_t(1) << (SUB_BITS - 1);
+    static const size_t BUCKETS = (64 - SUB_BITS + 2) * HALF;
+
+    LatencyHistogram() : counts(BUCKETS) { reset(); }
+
+    static size_t bucket_of(uint64_t ns) {
+        if (ns < 2 * HALF)
+            return ns;
+        const unsigned shift = 63 - __builtin_clzll(ns) - (SUB_BITS - 1);
+        return shift * HALF + (ns >> shift);
+    }
+
+    static uint64_t bucket_lower(size_t idx) {
+        if (idx < 2 * HALF)
+            return idx;
+        const unsigned shift = idx / HALF - 1;
+        return uint64_t(idx % HALF + HALF) << shift;
+    }
+
+    static uint64_t bucket_upper(size_t idx) {
+        if (idx < 2 * HALF)
+            return idx;
+        const unsigned shift = idx / HALF - 1;
+        return bucket_lower(idx) + (uint64_t(1) << shift) - 1;
+    }
+
+    void record(uint64_t ns) {
+        counts[bucket_of(ns)]++;
+        total++;
+        sum_ns += ns;
+        if (ns < min_ns)
+            min_ns = ns;
+        if (ns > max_ns)
+            max_ns = ns;
+    }
+
+    // Records `times` samples of the same value at once.
+    void record(uint64_t ns, uint64_t times) {
+        if (!times)
+            return;
+        counts[bucket_of(ns)] += times;
+        total += times;
+        sum_ns += ns * times;
+        min_ns = std::min(min_ns, ns);
+        max_ns = std::max(max_ns, ns);
+    }
+
+    template<class Rep, class Period>
+    void record(const std::chrono::duration <Rep, Period> &dur) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(dur).count();
+        record(uint64_t(ns > 0 ? ns : 0));
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (size_t i = 0; i < BUCKETS; i++)
+            counts[i] += other.counts[i];
+        total += other.total;
+        sum_ns += other.sum_ns;
+        min_ns = std::min(min_ns, other.min_ns);
+        max_ns = std::max(max_ns, other.max_ns);
+    }
+
+    // Flat copy for memory shared between processes: the buckets, then the
+    // count, sum, min and max.
+    static const size_t FLAT_SIZE = BUCKETS + 4;
+
+    void flatten(uint64_t *out) const {
+        std::copy(counts.begin(), counts.end(), out);
+        out[BUCKETS] = total;
+        out[BUCKETS + 1] = sum_ns;
+        out[BUCKETS + 2] = min_ns;
+        out[BUCKETS + 3] = max_ns;
+    }
+
+    void merge_flat(const uint64_t *in) {
+        for (size_t i = 0; i < BUCKETS; i++)
+            counts[i] += in[i];
+        total += in[BUCKETS];
+        sum_ns += in[BUCKETS + 1];
+        min_ns = std::min(min_ns, in[BUCKETS + 2]);
+        max_ns = std::max(max_ns, in[BUCKETS + 3]);
+    }
+
+    void reset() {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        sum_ns = 0;
+        min_ns = UINT64_MAX;
+        max_ns = 0;
+    }
+
+    uint64_t count() const { return total; }
+
+    uint64_t count_at(size_t idx) const { return counts[idx]; }
+
+    uint64_t sum() const { return sum_ns; }
+
+    uint64_t min() const { return total ? min_ns : 0; }
+
+    uint64_t max() const { return max_ns; }
+
+    double mean() const { return total ? double(sum_ns) / total : 0; }
+
+    // Smallest recorded value such that `pct` percent of samples are not
+    // greater, up to bucket resolution.
+    uint64_t percentile(double pct) const {
+        if (!total)
+            return 0;
+        uint64_t target = uint64_t(std::ceil(pct / 100.0 * total));
+        if (target < 1)
+            target = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= target)
+                return std::max(std::min(bucket_upper(i), max_ns), min_ns);
+        }
+        return max_ns;
+    }
+
+private:
+    std::vector <uint64_t> counts;
+    uint64_t total;
+    uint64_t sum_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+};
+
+#endif
@@ -1,17 +1,35 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <condition_variable>
 #include <csignal>
+#include <exception>
+#include <functional>
 //#include <iostream>
 //#include <librados.hpp>
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
 #include <fstream>
 #include <thread>
 #include <vector>
 #include <system_error>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
+#include "aioqueue.h"
+#include "generators.h"
+#include "histogram.h"
 #include "mysignals.h"
+#include "payload.h"
+#include "placement.h"
 #include "radosutil.h"
+#include "report.h"
 
 using namespace librados;
 using namespace std;
@@ -21,21 +39,133 @@ struct bench_settings {
     string pool;
     string mode;
     string specific_bench_item;
+    string workload;
+    string write_mode;
+    string placement_cache;
+    string payload_file;
+    string output;
+    string output_format;
+    string compare;
+    double threshold_p50;
+    double threshold_p99;
+    double threshold_iops;
+    double compress_ratio;
+    double dedup_ratio;
+    double rate;
+    double slo_p99;
+    int search_max_qd;
+    int parallel;
+    size_t max_pairs;
+    bool interference;
+    int rw_mix;
     int threads;
+    int iodepth;
+    size_t objects_per_thread;
+    int clients;
+    int procs;
     int secs;
+    int warmup;
+    int interval;
+    int ready_timeout;
+    bool reuse_pool;
     size_t object_size;
     size_t block_size;
+    size_t prefill_block;
+    AccessPattern obj_pattern;
+    AccessPattern off_pattern;
+    uint64_t seed;
     void print_settings(){
         cout << "[Settings]" << endl;
         cout << "pool name: " << pool <<endl;
+        cout << "reuse pool: " << (reuse_pool ? "yes" : "no") << endl;
         cout << "mode: " << mode << endl;
+        cout << "workload: " << workload << endl;
+        if (workload == "rw-mix")
+            cout << "read percentage: " << rw_mix << endl;
+        if (workload == "write")
+            cout << "write mode: " << write_mode << endl;
+        if (workload != "read-seq" && !(workload == "write" && write_mode == "allocate")) {
+            cout << "object access: " << obj_pattern.describe() << endl;
+            cout << "offset access: " << off_pattern.describe() << endl;
+        }
+        cout << "seed: " << seed << endl;
+        if (!payload_file.empty()) {
+            cout << "payload file: " << payload_file << endl;
+        } else {
+            cout << "compress ratio: " << compress_ratio << endl;
+            cout << "dedup ratio: " << dedup_ratio << endl;
+        }
         cout << "specific_bench_item: " << specific_bench_item << endl;
+        if (interference)
+            cout << "interference pairs: " << (max_pairs ? to_string(max_pairs) : string("all")) << endl;
+        cout << "parallel items: " << (parallel ? to_string(parallel) : string("all")) << endl;
         cout << "threads: " << threads << endl;
+        cout << "iodepth: " << iodepth << endl;
+        cout << "objects per thread: " << objects_per_thread << endl;
+        cout << "clients: " << clients << endl;
+        cout << "processes: " << procs << endl;
+        if (rate > 0)
+            cout << "target rate: " << rate << " iops" << endl;
+        if (slo_p99 > 0) {
+            cout << "p99 SLO: " << slo_p99 << " ms" << endl;
+            cout << "max search iodepth: " << search_max_qd << endl;
+        }
         cout << "duration: " << secs << endl;
+        cout << "warmup: " << warmup << endl;
+        cout << "report interval: " << interval << endl;
         cout << "block size: " << block_size <<endl;
+        cout << "object size: " << object_size <<endl;
+        if (!output.empty())
+            cout << "output: " << output << " (" << output_format << ")" << endl;
+        if (!compare.empty()) {
+            cout << "baseline: " << compare << endl;
+            cout << "regression thresholds: p50 +" << threshold_p50 << "%, p99 +" << threshold_p99
+                 << "%, iops -" << threshold_iops << "%" << endl;
+        }
     };
+    void report_settings(BenchReport &report) const {
+        report.add_setting("pool", pool);
+        report.add_setting("reuse_pool", reuse_pool);
+        report.add_setting("mode", mode);
+        report.add_setting("specific_bench_item", specific_bench_item);
+        report.add_setting("workload", workload);
+        report.add_setting("rw_mix", rw_mix);
+        report.add_setting("write_mode", write_mode);
+        report.add_setting("obj_dist", obj_pattern.describe());
+        report.add_setting("off_dist", off_pattern.describe());
+        report.add_setting("seed", seed);
+        report.add_setting("payload_file", payload_file);
+        report.add_setting("compress_ratio", compress_ratio);
+        report.add_setting("dedup_ratio", dedup_ratio);
+        report.add_setting("parallel", parallel);
+        report.add_setting("threads", threads);
+        report.add_setting("iodepth", iodepth);
+        report.add_setting("objects_per_thread", objects_per_thread);
+        report.add_setting("clients", clients);
+        report.add_setting("procs", procs);
+        report.add_setting("rate", rate);
+        report.add_setting("duration", secs);
+        report.add_setting("warmup", warmup);
+        report.add_setting("interval", interval);
+        report.add_setting("block_size", block_size);
+        report.add_setting("object_size", object_size);
+    }
 };
 
+enum op_type {
+    OP_WRITE,
+    OP_READ,
+    OP_TYPES
+};
+
+static const char *const op_names[OP_TYPES] = {"writes", "reads"};
+
+// Per-thread latency record; its size does not depend on the run length.
+typedef array <LatencyHistogram, OP_TYPES> op_latencies;
+
+// IoCtx of every client connection; bench thread i uses client i % size().
+typedef vector <IoCtx> client_ioctxs;
+
 template<class T>
 static double dur2sec(const T &dur) {
     return duration_cast < duration < double >> (dur).count();
@@ -51,39 +181,44 @@ static uint64_t dur2nsec(const T &dur) {
     return duration_cast < duration < uint64_t, nano >> (dur).count();
 }
 
-template<class T>
-static void print_breakdown(const vector <T> &all_ops, size_t thread_count) {
-    T totaltime(0);
-
-    map <size_t, size_t> dur2count;
-    map <size_t, T> dur2totaltime;
-
-    T mindur(minutes(42));
-    T maxdur(0);
-    size_t maxcount = 0;
-    for (const auto &res : all_ops) {
-        totaltime += res;
-        if (res > maxdur)
-            maxdur = res;
-        if (res < mindur)
-            mindur = res;
-
-        const auto nsec = dur2nsec(res);
+static double nsec2msec(uint64_t nsec) {
+    return nsec / 1000000.0;
+}
+
+// time_share is the fraction of the in-flight time spent on this op type, so
+// that iops of each type in a mixed workload add up to the total. When the
+// load is paced, threads are not always busy and iops are taken from the
+// wall clock duration `paced_secs` instead.
+static void print_breakdown(const LatencyHistogram &hist, size_t thread_count, size_t iodepth = 1,
+                            const string &op_name = "writes", double time_share = 1.0,
+                            double paced_secs = 0) {
+    if (!hist.count())
+        return;
+
+    // Fold the fine buckets into decimal groups: 1ms, 2ms, ... 9ms, 10ms, 20ms
+    vector <pair<size_t, uint64_t>> dur2count;
+    uint64_t maxcount = 0;
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++) {
+        const auto count = hist.count_at(i);
+        if (!count)
+            continue;
+
+        const auto nsec = LatencyHistogram::bucket_lower(i);
         size_t baserange = 10;
         while (nsec >= baserange)
             baserange *= 10;
         baserange /= 10;
         const size_t range = (nsec / baserange) * baserange;
 
-        const auto cnt = ++(dur2count[range]);
+        if (dur2count.empty() || dur2count.back().first != range)
+            dur2count.push_back(make_pair(range, 0));
+        const auto cnt = (dur2count.back().second += count);
         if (cnt > maxcount)
             maxcount = cnt;
-
-        dur2totaltime[range] += res;
     }
 
-    cout << "min latency " << dur2msec(mindur) << " ms" << endl;
-    cout << "max latency " << dur2msec(maxdur) << " ms" << endl;
+    cout << "min latency " << nsec2msec(hist.min()) << " ms" << endl;
+    cout << "max latency " << nsec2msec(hist.max()) << " ms" << endl;
 
     const size_t maxbarsize = 30;
 
@@ -94,18 +229,26 @@ static void print_breakdown(const vector <T> &all_ops, size_t thread_count) {
 
         auto bar = string(barsize, '#') + string(maxbarsize - barsize, ' ');
         cout << ">=" << setw(5) << nsecgrp / 1000000.0;
-        cout << " ms: " << setw(3) << count * 100 / all_ops.size() << "% " << bar;
+        cout << " ms: " << setw(3) << count * 100 / hist.count() << "% " << bar;
         cout << " cnt=" << count << endl;
     }
 
-    cout << "Average iops: " << (all_ops.size() * thread_count / dur2sec(totaltime)) << endl;
+    static const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+    for (const auto pct : percentiles)
+        cout << "p" << pct << " latency " << nsec2msec(hist.percentile(pct)) << " ms" << endl;
 
-    cout << "Average latency: " << (dur2msec(totaltime) / all_ops.size()) << " ms" << endl;
+    const double totalsecs = hist.sum() / 1e9;
+    const double iops = paced_secs > 0 ? hist.count() / paced_secs
+                                       : hist.count() * thread_count * iodepth * time_share / totalsecs;
 
-    cout << "Total writes: " << all_ops.size() << endl;
+    cout << "Average iops: " << iops << endl;
+
+    cout << "Average latency: " << nsec2msec(hist.mean()) << " ms" << endl;
+
+    cout << "Total " << op_name << ": " << hist.count() << endl;
 
     if (thread_count > 1)
-        cout << "iops per thread: " << (all_ops.size() / dur2sec(totaltime)) << endl;
+        cout << "iops per thread: " << iops / thread_count << endl;
 }
 
 static void fill_urandom(char *buf, size_t len) {
@@ -115,106 +258,1494 @@ static void fill_urandom(char *buf, size_t len) {
     infile.read(buf, len);
 }
 
+// Starts a thread with all signals blocked, so that only the main thread
+// sees SIGINT/SIGTERM.
+template<class... Args>
+static thread start_thread(Args &&... args) {
+    sigset_t new_set;
+    sigset_t old_set;
+    sigfillset(&new_set);
+    int err;
+    if ((err = pthread_sigmask(SIG_SETMASK, &new_set, &old_set))) {
+        throw std::system_error(err, std::system_category(), "Failed to set thread sigmask");
+    }
+
+    thread th(std::forward<Args>(args)...);
+
+    if ((err = pthread_sigmask(SIG_SETMASK, &old_set, NULL))) {
+        throw std::system_error(err, std::system_category(), "Failed to restore thread sigmask");
+    }
+    return th;
+}
+
+// Latencies of the current report interval of one bench thread.
+struct interval_stats {
+    mutex lock;
+    op_latencies ops;
+};
+
+// Prints iops, bandwidth and p50/p99 of every interval while a bench runs,
+// so that stalls show up instead of being averaged away.
+class IntervalReporter {
+public:
+    IntervalReporter(const bench_settings &settings_, const string &bench_item_, size_t threads)
+            : settings(settings_), bench_item(bench_item_), stats(threads), done(false) {}
+
+    ~IntervalReporter() { stop(); }
+
+    // Interval records, complete once stop() returned.
+    const vector <ReportInterval> &get_series() const { return series; }
+
+    interval_stats *stats_for(size_t thread_idx) {
+        return settings.interval > 0 ? &stats[thread_idx] : nullptr;
+    }
+
+    void start() {
+        if (settings.interval > 0)
+            reporter = start_thread(&IntervalReporter::run, this);
+    }
+
+    void stop() {
+        {
+            lock_guard <mutex> guard(lock);
+            done = true;
+        }
+        cond.notify_all();
+        if (reporter.joinable())
+            reporter.join();
+    }
+
+private:
+    void run() {
+        const auto begin = steady_clock::now();
+        auto last = begin;
+        op_latencies sum;
+
+        unique_lock <mutex> guard(lock);
+        while (!done) {
+            const auto next = last + seconds(settings.interval);
+            if (cond.wait_until(guard, next, [this] { return done; }))
+                break;
+
+            const auto now = steady_clock::now();
+            for (int t = 0; t < OP_TYPES; t++)
+                sum[t].reset();
+            for (auto &st : stats) {
+                lock_guard <mutex> stguard(st.lock);
+                for (int t = 0; t < OP_TYPES; t++) {
+                    sum[t].merge(st.ops[t]);
+                    st.ops[t].reset();
+                }
+            }
+
+            const double secs = dur2sec(now - last);
+            for (int t = 0; t < OP_TYPES; t++) {
+                const bool active = settings.workload == "rw-mix" ||
+                                    (t == OP_READ) == (settings.workload != "write");
+                if (!active)
+                    continue;
+                const ReportInterval rec = {dur2sec(now - begin), op_names[t], sum[t].count(),
+                                            sum[t].count() / secs,
+                                            sum[t].count() * settings.block_size / secs / 1048576,
+                                            sum[t].percentile(50), sum[t].percentile(99)};
+                series.push_back(rec);
+                cout << "[" << bench_item << "] " << setw(4) << lround(rec.t) << "s "
+                     << op_names[t] << ": " << lround(rec.iops) << " iops, "
+                     << rec.mib_s << " MiB/s, p50 "
+                     << nsec2msec(rec.p50) << " ms, p99 "
+                     << nsec2msec(rec.p99) << " ms" << endl;
+            }
+            last = now;
+        }
+    }
+
+    const bench_settings &settings;
+    const string bench_item;
+    vector <interval_stats> stats;
+    vector <ReportInterval> series;
+
+    thread reporter;
+    mutex lock;
+    condition_variable cond;
+    bool done;
+};
+
+// Removes the given objects, keeping up to 64 removes in flight.
+static void remove_objects(IoCtx &ioctx, const vector <string> &obj_names) {
+    AioQueue aio(64);
+    for (const auto &obj_name : obj_names) {
+        if (aio.full())
+            aio.wait();
+        aio.submit([&](AioCompletion *c, bufferlist *) {
+            return ioctx.aio_remove(obj_name, c);
+        });
+    }
+    aio.drain();
+}
+
+// Brings every object to full object_size with large sequential writes, so
+// that the measured ops are overwrites and reads never hit holes. Objects are
+// spread over the bench threads, each keeping 16 writes in flight through the
+// client it benches with.
+static void prefill_objects(
+        const unique_ptr <bench_settings> &settings,
+        const vector <string> &obj_names,
+        client_ioctxs &ioctxs) {
+    const size_t chunk = min(settings->object_size, settings->prefill_block);
+
+    bufferlist bl;
+    bl.append(ceph::buffer::create(chunk));
+    fill_urandom(bl.c_str(), chunk);
+
+    auto prefill = [&](size_t first) {
+        IoCtx &ioctx = ioctxs[first % ioctxs.size()];
+        AioQueue aio(16);
+        auto reap = [&]() {
+            if (aio.wait().ret < 0)
+                throw "Prefill error";
+        };
+
+        for (size_t i = first; i < obj_names.size(); i += settings->threads) {
+            abort_if_signalled();
+            for (size_t offset = 0; offset < settings->object_size; offset += chunk) {
+                if (aio.full())
+                    reap();
+                const auto len = min(chunk, settings->object_size - offset);
+                aio.submit([&](AioCompletion *c, bufferlist *) {
+                    return ioctx.aio_write(obj_names[i], c, bl, len, offset);
+                });
+            }
+        }
+
+        while (aio.pending())
+            reap();
+    };
+
+    // Errors are passed to the calling thread once every thread is joined
+    vector <exception_ptr> errors(settings->threads);
+    auto run = [&](int i) {
+        try {
+            prefill(i);
+        } catch (...) {
+            errors[i] = current_exception();
+        }
+    };
+
+    vector <thread> threads;
+    for (int i = 1; i < settings->threads; i++)
+        threads.push_back(start_thread(run, i));
+    run(0);
+    for (auto &th : threads)
+        th.join();
+    for (const auto &err : errors)
+        if (err)
+            rethrow_exception(err);
+}
+
+// Whether every run needs freshly removed objects rather than prefilled ones.
+static bool allocates(const bench_settings &settings) {
+    return settings.workload == "write" && settings.write_mode == "allocate";
+}
+
+// Sets up the objects of one bench item according to the write mode.
+static void prepare_objects(
+        const unique_ptr <bench_settings> &settings,
+        const vector <string> &obj_names,
+        client_ioctxs &ioctxs) {
+    if (allocates(*settings)) {
+        // Sparse objects, of which the bench writes every block once
+        remove_objects(ioctxs[0], obj_names);
+        return;
+    }
+
+    cout << "Prefilling " << obj_names.size() << " objects" << endl;
+    const auto b = steady_clock::now();
+    prefill_objects(settings, obj_names, ioctxs);
+    const double secs = dur2sec(steady_clock::now() - b);
+    cout << "Prefilled in " << secs << " s, "
+         << obj_names.size() * settings->object_size / secs / 1048576 << " MiB/s" << endl;
+}
+
+// Synchronises the bench threads of one item: nobody starts warming up
+// before every thread finished its setup, and the first thread to fail
+// stops the others.
+class RunControl {
+public:
+    // `rendezvous` is called by the last thread to arrive and returns the
+    // start time; it lets the threads of several processes start together.
+    explicit RunControl(size_t threads, function<steady_clock::time_point()> rendezvous_ = nullptr)
+            : waiting(threads), stopped(false), rendezvous(rendezvous_) {}
+
+    // Returns the common start time, taken when the last thread arrives.
+    steady_clock::time_point wait_start() {
+        unique_lock <mutex> guard(lock);
+        if (--waiting == 0) {
+            try {
+                start = rendezvous ? rendezvous() : steady_clock::now();
+            } catch (...) {
+                if (!stopped) {
+                    stopped = true;
+                    error = current_exception();
+                }
+                cond.notify_all();
+                throw;
+            }
+            cond.notify_all();
+        } else {
+            cond.wait(guard, [this] { return waiting == 0 || stopped; });
+        }
+        if (stopped)
+            throw "Another bench thread failed";
+        return start;
+    }
+
+    void fail(exception_ptr err) {
+        lock_guard <mutex> guard(lock);
+        if (!stopped) {
+            stopped = true;
+            error = err;
+        }
+        cond.notify_all();
+    }
+
+    // Polled by the bench threads on every op, so it does not take the lock.
+    bool failed() const {
+        return stopped.load(memory_order_acquire);
+    }
+
+    void rethrow() {
+        if (error)
+            rethrow_exception(error);
+    }
+
+private:
+    mutex lock;
+    condition_variable cond;
+    size_t waiting;
+    atomic<bool> stopped; // only set with the lock held
+    exception_ptr error;
+    steady_clock::time_point start;
+    function<steady_clock::time_point()> rendezvous;
+};
+
+// One bench thread: setup, then warmup and measure phases starting at the
+// same moment in all threads, then teardown of the ops still in flight.
+// Only ops submitted during the measure phase are counted in the totals, the
+// interval report shows the warmup as well.
+//
+// With a target rate ops are sent on a fixed timeline instead of as soon as
+// the previous one finished, and `corrected` gets each latency measured from
+// the intended send time, so that stalls are not hidden by coordinated
+// omission. The timelines of the `threads * procs` threads sharing the rate
+// are offset by `sender`, so that they do not all send at the same instant.
 // May be called in a thread.
 static void _do_bench(
         const unique_ptr <bench_settings> &settings,
-        const vector <string> &obj_names,
+        const string *obj_names,
+        size_t obj_count,
         IoCtx &ioctx,
-        vector <steady_clock::duration> &ops) {
-    // TODO: pass bufferlist as arguments
-    bufferlist bar1;
-    bufferlist bar2;
+        op_latencies &ops,
+        op_latencies &corrected,
+        interval_stats *interval,
+        RunControl &control,
+        const PayloadPool &payload,
+        uint64_t seed,
+        size_t sender) {
+    const bool reading = settings->workload != "write";
+    const bool mixed = settings->workload == "rw-mix";
+    const bool sequential = settings->workload == "read-seq";
+    const bool open_loop = settings->rate > 0;
+    const size_t blocks_per_object = settings->object_size / settings->block_size;
+
+    // Setup
+    Rng rng(seed);
+    const auto obj_gen = IndexGenerator::create(settings->obj_pattern, obj_count);
+    const auto off_gen = IndexGenerator::create(settings->off_pattern, blocks_per_object);
+
+    // In allocate mode every block of the objects is written once, going
+    // round the objects and through the blocks in a shuffled order.
+    const bool allocating = allocates(*settings);
+    vector<size_t> block_order;
+    if (allocating) {
+        for (size_t i = 0; i < blocks_per_object; i++)
+            block_order.push_back(i);
+        for (size_t i = 0; i + 1 < blocks_per_object; i++)
+            swap(block_order[i], block_order[i + rng.below(blocks_per_object - i)]);
+    }
 
-    bar1.append(ceph::buffer::create(settings->block_size));
-    fill_urandom(bar1.c_str(), settings->block_size);
+    auto payloads = payload.get_blocks();
+    size_t submitted = rng.below(payloads.size());
+
+    const auto period = open_loop
+                        ? duration_cast<steady_clock::duration>(duration<double>(settings->threads / settings->rate))
+                        : steady_clock::duration(0);
+
+    const auto start = control.wait_start();
+    const auto measure = start + seconds(settings->warmup);
+    const auto stop = measure + seconds(settings->secs);
+    const int64_t senders = (int64_t) settings->threads * settings->procs;
+    auto intended = start + period * (int64_t) sender / senders;
+
+    auto record = [&](unsigned type, steady_clock::time_point scheduled, steady_clock::duration latency,
+                      steady_clock::duration latency_corrected) {
+        if (scheduled >= measure) {
+            ops[type].record(latency);
+            if (open_loop)
+                corrected[type].record(latency_corrected);
+        }
+        if (interval) {
+            lock_guard <mutex> guard(interval->lock);
+            interval->ops[type].record(latency);
+        }
+    };
 
-    bar2.append(ceph::buffer::create(settings->block_size));
-    fill_urandom(bar2.c_str(), settings->block_size);
+    size_t seq = 0;
+    // Picks type, object and offset of the next op.
+    auto next_op = [&](op_type &type, const string *&obj_name, uint64_t &offset) {
+        if (mixed)
+            type = (rng.below(100) < (unsigned) settings->rw_mix) ? OP_READ : OP_WRITE;
+        else
+            type = reading ? OP_READ : OP_WRITE;
+
+        if (allocating) {
+            if (seq == obj_count * blocks_per_object)
+                throw "Every block was written once in allocate mode, use more --objects or a larger -o";
+            obj_name = &obj_names[seq % obj_count];
+            offset = settings->block_size * block_order[seq / obj_count];
+            seq++;
+        } else if (sequential) {
+            obj_name = &obj_names[(seq / blocks_per_object) % obj_count];
+            offset = settings->block_size * (seq % blocks_per_object);
+            seq++;
+        } else {
+            obj_name = &obj_names[obj_gen->next(rng)];
+            offset = settings->block_size * off_gen->next(rng);
+        }
+    };
 
-    if (bar1.contents_equal(bar2))
-        throw "Your RNG is not random";
+    if (settings->iodepth > 1) {
+        AioQueue aio(settings->iodepth);
+
+        auto handle = [&](const AioResult &res) {
+            if (res.ret < 0)
+                throw res.tag == OP_READ ? "Read error" : "Write error";
+            record(res.tag, res.intended, res.latency, res.submitted + res.latency - res.intended);
+        };
+
+        // Warmup and measure
+        while (!control.failed()) {
+            abort_if_signalled();
+            const auto now = steady_clock::now();
+            if (now >= stop)
+                break;
+
+            while (!aio.full() && (!open_loop || (intended <= now && intended < stop))) {
+                const auto &bar = payloads[submitted++ % payloads.size()];
+                op_type type;
+                const string *obj_name;
+                uint64_t offset;
+                next_op(type, obj_name, offset);
+                aio.submit([&](AioCompletion *c, bufferlist *data) {
+                    if (type == OP_READ)
+                        return ioctx.aio_read(*obj_name, c, data, settings->block_size, offset);
+                    return ioctx.aio_write(*obj_name, c, bar, settings->block_size, offset);
+                }, type, open_loop ? intended : steady_clock::time_point());
+                intended += period;
+            }
 
-    auto b = steady_clock::now();
-    const auto stop = b + seconds(settings->secs);
+            if (!open_loop || aio.full()) {
+                handle(aio.wait());
+            } else {
+                // A slot is free, wake up for a completion or the next send time.
+                const auto wakeup = min(intended, stop);
+                AioResult res;
+                if (!aio.pending())
+                    this_thread::sleep_until(wakeup);
+                else if (aio.wait_until(wakeup, res))
+                    handle(res);
+            }
+        }
 
-    for (const auto &obj_name : obj_names) {
-        ioctx.remove(obj_name);
+        // Teardown
+        while (aio.pending())
+            handle(aio.wait());
+        return;
     }
 
-    while (b <= stop) {
+    bufferlist data;
+    while (!control.failed()) {
         abort_if_signalled();
-        if (ioctx.write(
-                obj_names[rand() % 16],
-                (ops.size() % 2) ? bar1 : bar2,
+        if (open_loop) {
+            if (intended >= stop)
+                break;
+            this_thread::sleep_until(intended);
+        }
+        const auto b = steady_clock::now();
+        if (b >= stop)
+            break;
+        if (!open_loop)
+            intended = b;
+
+        op_type type;
+        const string *obj_name;
+        uint64_t offset;
+        next_op(type, obj_name, offset);
+        if (type == OP_READ) {
+            data.clear();
+            if (ioctx.read(*obj_name, data, settings->block_size, offset) < 0)
+                throw "Read error";
+        } else if (ioctx.write(
+                *obj_name,
+                payloads[submitted++ % payloads.size()],
                 settings->block_size,
-                settings->block_size * (rand() % (settings->object_size / settings->block_size))
+                offset
         ) < 0) {
             throw "Write error";
         }
         const auto b2 = steady_clock::now();
-        ops.push_back(b2 - b);
-        b = b2;
+        record(type, intended, b2 - b, b2 - intended);
+        intended += period;
     }
 }
 
-static void do_bench(const unique_ptr <bench_settings> &settings, const vector <string> &names, IoCtx &ioctx) {
-    vector <steady_clock::duration> all_ops;
+// Merged latencies of all threads of one bench run.
+struct bench_result {
+    op_latencies ops;
+    op_latencies corrected;
+    vector <LatencyHistogram> clients; // all ops of each client
+    vector <ReportInterval> series;
+    double secs;
+
+    LatencyHistogram all() const {
+        LatencyHistogram hist;
+        for (int t = 0; t < OP_TYPES; t++)
+            hist.merge(ops[t]);
+        return hist;
+    }
+
+    double iops() const { return all().count() / secs; }
+};
+
+// Runs one bench item. `prepare` is cleared by callers that run the same
+// objects again or prefilled them already. Items run at the same time share
+// `shared_control`, so that their measure phases start together. Worker
+// processes pass the index of their first thread as `first_sender`.
+static bench_result do_bench(const unique_ptr <bench_settings> &settings, const string &bench_item,
+                             const vector <string> &names, client_ioctxs &ioctxs, const PayloadPool &payload,
+                             bool prepare = true, RunControl *shared_control = nullptr,
+                             size_t first_sender = 0) {
+    // Prefill
+    if (prepare)
+        prepare_objects(settings, names, ioctxs);
+
+    vector <op_latencies> listofops(settings->threads);
+    vector <op_latencies> listofcorrected(settings->threads);
+    RunControl own_control(settings->threads);
+    RunControl &control = shared_control ? *shared_control : own_control;
+    IntervalReporter reporter(*settings, bench_item, settings->threads);
+
+    auto worker = [&](int i) {
+        try {
+            _do_bench(settings, &names[i * settings->objects_per_thread], settings->objects_per_thread,
+                      ioctxs[i % ioctxs.size()], listofops[i], listofcorrected[i], reporter.stats_for(i),
+                      control, payload,
+                      settings->seed + ((uint64_t) i << 32), first_sender + i);
+        } catch (...) {
+            control.fail(current_exception());
+        }
+    };
 
+    reporter.start();
     if (settings->threads > 1) {
         vector <thread> threads;
-        vector <vector<steady_clock::duration>> listofops;
 
         for (int i = 0; i < settings->threads; i++) {
-            listofops.push_back(vector<steady_clock::duration>());
+            threads.push_back(start_thread(worker, i));
         }
 
-        for (int i = 0; i < settings->threads; i++) {
-            sigset_t new_set;
-            sigset_t old_set;
-            sigfillset(&new_set);
-            int err;
-            if ((err = pthread_sigmask(SIG_SETMASK, &new_set, &old_set))) {
-                throw std::system_error(err, std::system_category(), "Failed to set thread sigmask");
-            }
+        for (auto &th : threads) {
+            th.join();
+        }
+    } else {
+        worker(0);
+    }
+    reporter.stop();
+    control.rethrow();
+
+    bench_result result;
+    result.secs = settings->secs;
+    result.series = reporter.get_series();
+    result.clients.resize(ioctxs.size());
+    for (int i = 0; i < settings->threads; i++) {
+        for (int t = 0; t < OP_TYPES; t++) {
+            result.ops[t].merge(listofops[i][t]);
+            result.corrected[t].merge(listofcorrected[i][t]);
+            result.clients[i % ioctxs.size()].merge(listofops[i][t]);
+        }
+    }
+    return result;
+}
+
+static ReportItem to_report_item(const string &bench_item, const bench_result &result) {
+    ReportItem item;
+    item.name = bench_item;
+    for (int t = 0; t < OP_TYPES; t++) {
+        if (!result.ops[t].count())
+            continue;
+        const ReportOp op = {op_names[t], result.ops[t], result.ops[t].count() / result.secs};
+        item.ops.push_back(op);
+    }
+    item.series = result.series;
+    return item;
+}
+
+// Runs several bench items at the same time, each with its own threads and
+// stats. All objects are prefilled first and the measure phases of all items
+// start together, so the items load the cluster over the same window.
+static vector <bench_result> do_bench_concurrently(const unique_ptr <bench_settings> &settings,
+                                                   const vector<const item_names::value_type *> &items,
+                                                   client_ioctxs &ioctxs, const PayloadPool &payload,
+                                                   bool prepare = true) {
+    vector <bench_result> results(items.size());
+    if (items.size() == 1) {
+        results[0] = do_bench(settings, items[0]->first, items[0]->second, ioctxs, payload, prepare);
+        return results;
+    }
+
+    vector <exception_ptr> errors(items.size());
+    auto run_all = [&](const function<void(size_t)> &fn) {
+        vector <thread> threads;
+        for (size_t i = 0; i < items.size(); i++) {
+            threads.push_back(start_thread([&, i] {
+                try {
+                    fn(i);
+                } catch (...) {
+                    errors[i] = current_exception();
+                }
+            }));
+        }
+        for (auto &th : threads)
+            th.join();
+        for (const auto &err : errors)
+            if (err)
+                rethrow_exception(err);
+    };
+
+    if (prepare) {
+        run_all([&](size_t i) {
+            prepare_objects(settings, items[i]->second, ioctxs);
+        });
+    }
+
+    RunControl control(settings->threads * items.size());
+    run_all([&](size_t i) {
+        results[i] = do_bench(settings, items[i]->first, items[i]->second, ioctxs, payload, false, &control);
+    });
+    return results;
+}
+
+static void print_result(const unique_ptr <bench_settings> &settings, const bench_result &result) {
+    const auto &all_ops = result.ops;
+    const auto &all_corrected = result.corrected;
+
+    uint64_t totalbusy = 0;
+    for (int t = 0; t < OP_TYPES; t++)
+        totalbusy += all_ops[t].sum();
+
+    const bool open_loop = settings->rate > 0;
+    const double paced_secs = open_loop ? result.secs : 0;
+
+    for (int t = 0; t < OP_TYPES; t++) {
+        if (!all_ops[t].count())
+            continue;
+        if (settings->workload == "rw-mix" || open_loop)
+            cout << "[" << op_names[t] << "]" << endl;
+        print_breakdown(all_ops[t], settings->threads, settings->iodepth, op_names[t],
+                        double(all_ops[t].sum()) / totalbusy, paced_secs);
+        if (open_loop) {
+            cout << "[" << op_names[t] << ", latency from intended send time]" << endl;
+            print_breakdown(all_corrected[t], settings->threads, settings->iodepth, op_names[t],
+                            double(all_ops[t].sum()) / totalbusy, paced_secs);
+        }
+    }
+
+    // A client that is much slower than the others points at the client
+    // side rather than at the OSD.
+    if (result.clients.size() > 1) {
+        cout << "[clients]" << endl;
+        for (size_t c = 0; c < result.clients.size(); c++) {
+            const auto &hist = result.clients[c];
+            const size_t threads = (settings->threads - c + result.clients.size() - 1) / result.clients.size();
+            cout << "client " << c << " (" << threads << " threads): " << lround(hist.count() / result.secs)
+                 << " iops, p50 " << nsec2msec(hist.percentile(50)) << " ms, p99 "
+                 << nsec2msec(hist.percentile(99)) << " ms" << endl;
+        }
+    }
+}
+
+// One measured point of a saturation search.
+struct saturation_point {
+    int iodepth;
+    double iops;
+    uint64_t p50;
+    uint64_t p99;
+};
+
+// Looks for the highest throughput of one bench item whose p99 stays within
+// the SLO. The queue depth is doubled until p99 breaks the SLO, then bisected
+// between the last depth that met it and the first that did not.
+static void search_saturation(const unique_ptr <bench_settings> &settings, const string &bench_item,
+                              const vector <string> &names, client_ioctxs &ioctxs, const PayloadPool &payload) {
+    const uint64_t slo = settings->slo_p99 * 1000000;
+    map<int, saturation_point> curve;
+
+    auto run = [&](int iodepth) -> const saturation_point & {
+        const auto it = curve.find(iodepth);
+        if (it != curve.end())
+            return it->second;
+
+        const unique_ptr <bench_settings> step(new bench_settings(*settings));
+        step->iodepth = iodepth;
+        const auto result = do_bench(step, bench_item, names, ioctxs, payload,
+                                     curve.empty() || allocates(*settings));
+        const auto hist = result.all();
+
+        auto &point = curve[iodepth];
+        point.iodepth = iodepth;
+        point.iops = result.iops();
+        point.p50 = hist.percentile(50);
+        point.p99 = hist.percentile(99);
+        cout << "[" << bench_item << "] iodepth " << iodepth << ": " << lround(point.iops) << " iops, p50 "
+             << nsec2msec(point.p50) << " ms, p99 " << nsec2msec(point.p99) << " ms" << endl;
+        return point;
+    };
+
+    int good = 0;
+    int bad = 0;
+    for (int iodepth = 1; iodepth <= settings->search_max_qd; iodepth *= 2) {
+        if (run(iodepth).p99 > slo) {
+            bad = iodepth;
+            break;
+        }
+        good = iodepth;
+    }
+    while (good && bad - good > 1) {
+        const int mid = (good + bad) / 2;
+        if (run(mid).p99 > slo)
+            bad = mid;
+        else
+            good = mid;
+    }
+
+    // Past saturation iops may drop while p99 is still fine, so the knee is
+    // the best point within the SLO rather than the deepest one.
+    const saturation_point *knee = nullptr;
+    cout << "[Saturation curve]" << endl;
+    cout << setw(8) << "iodepth" << setw(12) << "iops" << setw(12) << "p50 ms" << setw(12) << "p99 ms" << endl;
+    for (const auto &p : curve) {
+        const auto &point = p.second;
+        const bool within = point.p99 <= slo;
+        cout << setw(8) << point.iodepth << setw(12) << lround(point.iops)
+             << setw(12) << nsec2msec(point.p50) << setw(12) << nsec2msec(point.p99)
+             << (within ? "" : "  over SLO") << endl;
+        if (within && (!knee || point.iops > knee->iops))
+            knee = &point;
+    }
+
+    if (knee)
+        cout << "Max iops within p99 " << settings->slo_p99 << " ms: " << lround(knee->iops)
+             << " at iodepth " << knee->iodepth << " (p99 " << nsec2msec(knee->p99) << " ms)" << endl;
+    else
+        cout << "p99 " << settings->slo_p99 << " ms is not met even at iodepth 1" << endl;
+}
+
+// Benches every item alone and then pairs of items together, and reports how
+// much each item loses next to each partner. Pairs within one failure domain
+// (host for osd mode, rack for host mode) go first; pairs across domains
+// share no hardware and serve as the control group. `max_pairs` samples that
+// many pairs, split between both groups.
+static void bench_interference(const unique_ptr <bench_settings> &settings, const item_names &name2location,
+                               const osd_locations &osd2location, client_ioctxs &ioctxs,
+                               const PayloadPool &payload) {
+    const string domain = settings->mode == "osd" ? "host" : "rack";
+    map<string, string> item2domain;
+    for (const auto &p : osd2location) {
+        const auto it = p.second.find(domain);
+        item2domain[p.second.at(settings->mode)] = it != p.second.end() ? it->second : string();
+    }
+
+    vector<const item_names::value_type *> items;
+    for (const auto &p : name2location)
+        items.push_back(&p);
 
-            threads.push_back(thread(_do_bench, ref(settings),
-                                     vector<string>(names.begin() + i * 16, names.begin() + i * 16 + 16), ref(ioctx),
-                                     ref(listofops[i])));
+    map<string, bench_result> solo;
+    for (const auto item : items) {
+        cout << "Benching " << settings->mode << " " << item->first << " alone" << endl;
+        const auto &result = solo[item->first] = do_bench_concurrently(settings, {item}, ioctxs, payload)[0];
+        cout << "  " << item->first << ": " << lround(result.iops()) << " iops, p99 "
+             << nsec2msec(result.all().percentile(99)) << " ms" << endl;
+    }
+
+    // Slowdowns are relative to running alone, which needs ops to compare with
+    vector<const item_names::value_type *> measured;
+    for (const auto item : items) {
+        if (solo[item->first].all().count())
+            measured.push_back(item);
+        else
+            cout << "Unmeasurable: " << item->first << " completed no ops alone, left out of the pairs" << endl;
+    }
+    items.swap(measured);
+
+    vector <pair<size_t, size_t>> same;
+    vector <pair<size_t, size_t>> cross;
+    for (size_t i = 0; i < items.size(); i++)
+        for (size_t j = i + 1; j < items.size(); j++)
+            (item2domain[items[i]->first] == item2domain[items[j]->first] ? same : cross).push_back(make_pair(i, j));
+
+    if (settings->max_pairs) {
+        Rng rng(settings->seed);
+        auto sample = [&](vector <pair<size_t, size_t>> &pairs, size_t n) {
+            for (size_t i = 0; i < pairs.size() && i < n; i++)
+                swap(pairs[i], pairs[i + rng.below(pairs.size() - i)]);
+            if (pairs.size() > n)
+                pairs.resize(n);
+        };
+        const size_t half = settings->max_pairs / 2;
+        const size_t n_same = min(same.size(), max(half, settings->max_pairs - min(cross.size(), half)));
+        sample(same, n_same);
+        sample(cross, settings->max_pairs - n_same);
+    }
 
-            if ((err = pthread_sigmask(SIG_SETMASK, &old_set, NULL))) {
-                throw std::system_error(err, std::system_category(), "Failed to restore thread sigmask");
+    // paired[a][b]: result of a while running next to b
+    map<string, map<string, bench_result>> paired;
+    for (const auto group : {&same, &cross}) {
+        for (const auto &p : *group) {
+            const auto a = items[p.first];
+            const auto b = items[p.second];
+            cout << "Benching " << settings->mode << " " << a->first << " together with " << b->first
+                 << (group == &same ? ", same " : ", different ") << domain << endl;
+            const auto results = do_bench_concurrently(settings, {a, b}, ioctxs, payload, allocates(*settings));
+            paired[a->first][b->first] = results[0];
+            paired[b->first][a->first] = results[1];
+            for (int k = 0; k < 2; k++) {
+                const auto &name = k ? b->first : a->first;
+                const auto &base = solo[name];
+                cout << "  " << name << ": " << lround(results[k].iops()) << " iops ("
+                     << lround(100 * results[k].iops() / base.iops()) << "% of alone), p99 "
+                     << nsec2msec(results[k].all().percentile(99)) << " ms (alone "
+                     << nsec2msec(base.all().percentile(99)) << " ms)" << endl;
             }
         }
+    }
 
-        for (auto &th : threads) {
-            th.join();
+    int width = 10;
+    for (const auto item : items)
+        width = max(width, (int) item->first.size() + 2);
+
+    cout << "[Interference matrix: iops of row item next to column item, % of alone]" << endl;
+    cout << setw(width) << "";
+    for (const auto col : items)
+        cout << setw(width) << col->first;
+    cout << endl;
+    for (const auto row : items) {
+        cout << setw(width) << row->first;
+        for (const auto col : items) {
+            const auto &partners = paired[row->first];
+            const auto it = partners.find(col->first);
+            if (row == col)
+                cout << setw(width) << "-";
+            else if (it == partners.end())
+                cout << setw(width) << ".";
+            else
+                cout << setw(width) << lround(100 * it->second.iops() / solo[row->first].iops());
         }
+        cout << endl;
+    }
+
+    // Slowdown of a pair: the iops share kept by its weaker member.
+    auto kept = [&](const pair<size_t, size_t> &p) {
+        const auto &a = items[p.first]->first;
+        const auto &b = items[p.second]->first;
+        return min(paired[a][b].iops() / solo[a].iops(), paired[b][a].iops() / solo[b].iops());
+    };
+
+    double control = 0;
+    for (const auto &p : cross)
+        control += kept(p);
+    if (!cross.empty()) {
+        control /= cross.size();
+        cout << "Different " << domain << " pairs (control): " << lround(100 * control)
+             << "% of alone iops kept on average over " << cross.size() << " pairs" << endl;
+    }
 
-        for (const auto &res : listofops) {
-            all_ops.insert(all_ops.end(), res.begin(), res.end());
+    double same_mean = 0;
+    for (const auto &p : same)
+        same_mean += kept(p);
+    if (!same.empty()) {
+        same_mean /= same.size();
+        cout << "Same " << domain << " pairs: " << lround(100 * same_mean)
+             << "% of alone iops kept on average over " << same.size() << " pairs" << endl;
+    }
+
+    // Without a control group, an item pair is only compared to running alone.
+    const double reference = cross.empty() ? 1.0 : control;
+    for (const auto group : {&same, &cross}) {
+        for (const auto &p : *group) {
+            const double k = kept(p);
+            if (k < reference - 0.1)
+                cout << "Interference: " << items[p.first]->first << " and " << items[p.second]->first
+                     << " keep only " << lround(100 * k) << "% of alone iops" << endl;
         }
-    } else {
-        _do_bench(settings, names, ioctx, all_ops);
     }
-    print_breakdown(all_ops, settings->threads);
 }
 
-static void _main(int argc, const char *argv[]) {
+// Modified z-scores (Iglewicz and Hoaglin) of the values against their median
+// and median absolute deviation. MAD is kept at 1% of the median at least, so
+// that a population of near identical items does not flag noise.
+static vector<double> robust_zscores(const vector<double> &values) {
+    auto median = [](vector<double> v) {
+        sort(v.begin(), v.end());
+        const size_t n = v.size();
+        return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+    };
+
+    const double med = median(values);
+    vector<double> deviations;
+    for (const auto v : values)
+        deviations.push_back(fabs(v - med));
+    const double mad = max(median(deviations), fabs(med) / 100);
+
+    vector<double> scores;
+    for (const auto v : values)
+        scores.push_back(mad > 0 ? 0.6745 * (v - med) / mad : 0);
+    return scores;
+}
+
+// Flags items whose latency stands out from the rest. Two tests are used: the
+// robust z-score of p99, and that of the one-sided Kolmogorov-Smirnov distance
+// between the latency distribution of the item and that of all other items
+// pooled, which also catches items slow over the whole distribution with an
+// ordinary tail. Only slowness counts. An item is an outlier when either
+// score reaches 3.5; its confidence grows with both scores up to 7.
+static void print_outliers(const map<string, bench_result> &results) {
+    const double threshold = 3.5;
+
+    vector <string> names;
+    vector <LatencyHistogram> hists;
+    vector <uint64_t> pooled(LatencyHistogram::BUCKETS);
+    for (const auto &p : results) {
+        names.push_back(p.first);
+        hists.push_back(p.second.all());
+        for (size_t b = 0; b < LatencyHistogram::BUCKETS; b++)
+            pooled[b] += hists.back().count_at(b);
+    }
+    uint64_t pooled_count = 0;
+    for (const auto c : pooled)
+        pooled_count += c;
+
+    vector<double> p99s;
+    vector<double> distances;
+    for (const auto &hist : hists) {
+        p99s.push_back(hist.percentile(99));
+
+        // Largest amount by which the CDF of the others leads the item's
+        const uint64_t others_count = pooled_count - hist.count();
+        uint64_t seen = 0;
+        uint64_t others_seen = 0;
+        double distance = 0;
+        for (size_t b = 0; b < LatencyHistogram::BUCKETS && hist.count() && others_count; b++) {
+            seen += hist.count_at(b);
+            others_seen += pooled[b] - hist.count_at(b);
+            distance = max(distance, double(others_seen) / others_count - double(seen) / hist.count());
+        }
+        distances.push_back(distance);
+    }
+
+    const auto p99_scores = robust_zscores(p99s);
+    const auto distance_scores = robust_zscores(distances);
+
+    struct verdict {
+        size_t idx;
+        bool outlier;
+        double confidence;
+    };
+    vector <verdict> verdicts;
+    for (size_t i = 0; i < names.size(); i++) {
+        auto strength = [&](double z) { return min(max(z, 0.0) / (2 * threshold), 1.0); };
+        verdicts.push_back({i, max(p99_scores[i], distance_scores[i]) >= threshold,
+                            (strength(p99_scores[i]) + strength(distance_scores[i])) / 2});
+    }
+    stable_sort(verdicts.begin(), verdicts.end(), [](const verdict &a, const verdict &b) {
+        return a.outlier != b.outlier ? a.outlier : a.confidence > b.confidence;
+    });
+
+    cout << "[Outliers]" << endl;
+    if (!verdicts.front().outlier)
+        cout << "No outliers among " << names.size() << " items" << endl;
+    int width = 12;
+    for (const auto &name : names)
+        width = max(width, (int) name.size() + 2);
+    auto rounded = [](double x) { return round(x * 1000) / 1000; };
+
+    cout << setw(width) << "item" << setw(12) << "p99 ms" << setw(10) << "p99 z" << setw(10) << "KS D"
+         << setw(10) << "KS z" << setw(12) << "confidence" << endl;
+    for (const auto &v : verdicts) {
+        const auto i = v.idx;
+        cout << setw(width) << names[i] << setw(12) << nsec2msec(p99s[i]) << setw(10) << rounded(p99_scores[i])
+             << setw(10) << rounded(distances[i]) << setw(10) << rounded(distance_scores[i]) << setw(11)
+             << lround(100 * v.confidence) << "%" << (v.outlier ? "  OUTLIER" : "") << endl;
+    }
+}
+
+// Op results of a --output JSON file: item -> op -> result. Histograms are
+// rebuilt from the bucket lower bounds.
+typedef map<string, map<string, ReportOp>> report_ops;
+
+static report_ops load_report(const string &path) {
+    ifstream infile(path);
+    if (!infile)
+        throw "Failed to open baseline file";
+
+    Json::Value root;
+    Json::Reader reader(Json::Features::strictMode());
+    if (!reader.parse(infile, root) || !root.isObject() || root["schema"].asString() != REPORT_SCHEMA)
+        throw "Wrong baseline file";
+
+    report_ops result;
+    for (const auto &item : root["items"]) {
+        for (const auto &o : item["ops"]) {
+            auto &op = result[item["name"].asString()][o["op"].asString()];
+            op.op = o["op"].asString();
+            op.iops = o["iops"].asDouble();
+            for (const auto &bucket : o["buckets"])
+                op.hist.record(bucket[0].asUInt64(), bucket[2].asUInt64());
+        }
+    }
+    return result;
+}
+
+// P-value of the one-sided two sample Kolmogorov-Smirnov test that `current`
+// is slower than `baseline`, from the asymptotic distribution of D+.
+static double ks_slower_pvalue(const LatencyHistogram &baseline, const LatencyHistogram &current) {
+    if (!baseline.count() || !current.count())
+        return 1;
+
+    uint64_t base_seen = 0;
+    uint64_t cur_seen = 0;
+    double distance = 0;
+    for (size_t b = 0; b < LatencyHistogram::BUCKETS; b++) {
+        base_seen += baseline.count_at(b);
+        cur_seen += current.count_at(b);
+        distance = max(distance, double(base_seen) / baseline.count() - double(cur_seen) / current.count());
+    }
+
+    const double n = double(baseline.count()) * current.count() / (baseline.count() + current.count());
+    return exp(-2 * n * distance * distance);
+}
+
+// Compares every item and op of this run with the --compare baseline and
+// prints a diff table. An op regressed when its latency distribution is
+// significantly worse (KS p < 0.01) and p50, p99 or iops moved past their
+// thresholds. Returns whether anything regressed.
+static bool compare_with_baseline(const unique_ptr <bench_settings> &settings,
+                                  const map<string, bench_result> &results) {
+    const auto baseline = load_report(settings->compare);
+
+    auto change = [](double base, double cur) { return base > 0 ? 100 * (cur - base) / base : 0; };
+
+    bool regressed = false;
+    cout << "[Comparison with " << settings->compare << "]" << endl;
+    cout << setw(10) << "item" << setw(8) << "op" << setw(10) << "p50 ms" << setw(9) << "p50 %"
+         << setw(10) << "p99 ms" << setw(9) << "p99 %" << setw(10) << "iops" << setw(9) << "iops %"
+         << setw(13) << "KS p" << endl;
+    for (const auto &p : results) {
+        const auto base_item = baseline.find(p.first);
+        for (int t = 0; t < OP_TYPES; t++) {
+            const auto &hist = p.second.ops[t];
+            if (!hist.count())
+                continue;
+            if (base_item == baseline.end() || !base_item->second.count(op_names[t])) {
+                cout << setw(10) << p.first << setw(8) << op_names[t] << "  not in baseline" << endl;
+                continue;
+            }
+
+            const auto &base = base_item->second.at(op_names[t]);
+            const double p50 = change(base.hist.percentile(50), hist.percentile(50));
+            const double p99 = change(base.hist.percentile(99), hist.percentile(99));
+            const double iops = change(base.iops, hist.count() / p.second.secs);
+            const double pvalue = ks_slower_pvalue(base.hist, hist);
+
+            const bool worse = pvalue < 0.01 && (p50 > settings->threshold_p50 ||
+                                                 p99 > settings->threshold_p99 ||
+                                                 -iops > settings->threshold_iops);
+            regressed |= worse;
+            cout << setw(10) << p.first << setw(8) << op_names[t] << setw(10)
+                 << nsec2msec(hist.percentile(50)) << setw(8) << lround(p50) << "%" << setw(10)
+                 << nsec2msec(hist.percentile(99)) << setw(8) << lround(p99) << "%" << setw(10)
+                 << lround(hist.count() / p.second.secs) << setw(8) << lround(iops) << "%" << " "
+                 << setw(12) << pvalue << (worse ? "  REGRESSION" : "") << endl;
+        }
+    }
+
+    for (const auto &p : baseline)
+        if (!results.count(p.first))
+            cout << setw(10) << p.first << "  not benched in this run" << endl;
+
+    cout << (regressed ? "Regression detected" : "No regression") << endl;
+    return regressed;
+}
+
+// One bucket of the CRUSH tree with the merged latencies of the OSDs below.
+struct crush_node {
+    string type;
+    string name;
+    LatencyHistogram hist;
+    double iops;
+    set <string> children;
+};
+
+// Aggregates per-OSD results up the CRUSH tree (osd -> host -> rack -> ...
+// -> root) from the crush_location of every OSD, and prints the tree with the
+// slowest member by p99 marked at each level, so that a slow rack can be told
+// apart into one bad host or one bad disk.
+static void print_crush_rollup(const map<string, bench_result> &results, const osd_locations &osd2location) {
+    // Default CRUSH bucket types, bottom up
+    static const char *const types[] = {"host", "chassis", "rack", "row", "pdu", "pod",
+                                        "room", "datacenter", "zone", "region", "root"};
+
+    map<string, crush_node> nodes;
+    set <string> roots;
+    for (const auto &p : osd2location) {
+        const auto &location = p.second;
+        const auto result = results.find(location.at("osd"));
+        if (result == results.end())
+            continue;
+        const auto hist = result->second.all();
+
+        string child;
+        for (int level = -1; level < (int) (sizeof(types) / sizeof(types[0])); level++) {
+            const string type = level < 0 ? "osd" : types[level];
+            const auto it = location.find(type);
+            if (it == location.end())
+                continue;
+
+            const string key = type + " " + it->second;
+            auto &node = nodes[key];
+            if (node.type.empty()) {
+                node.type = type;
+                node.name = it->second;
+                node.iops = 0;
+            }
+            node.hist.merge(hist);
+            node.iops += result->second.iops();
+            if (!child.empty())
+                node.children.insert(child);
+            child = key;
+        }
+        roots.insert(child);
+    }
+
+    function<void(const string &, const string &, const string &)> print =
+            [&](const string &key, const string &indent, const string &mark) {
+                const auto &node = nodes.at(key);
+                cout << indent << node.type << " " << node.name << ": " << lround(node.iops) << " iops, p50 "
+                     << nsec2msec(node.hist.percentile(50)) << " ms, p99 "
+                     << nsec2msec(node.hist.percentile(99)) << " ms" << mark << endl;
+
+                string slowest;
+                uint64_t slowest_p99 = 0;
+                for (const auto &c : node.children) {
+                    const auto p99 = nodes.at(c).hist.percentile(99);
+                    if (slowest.empty() || p99 > slowest_p99) {
+                        slowest = c;
+                        slowest_p99 = p99;
+                    }
+                }
+                for (const auto &c : node.children)
+                    print(c, indent + "  ", c == slowest && node.children.size() > 1
+                                            ? "  <- slowest " + nodes.at(c).type + " of " + node.name : "");
+            };
+
+    cout << "[CRUSH roll-up]" << endl;
+    for (const auto &root : roots)
+        print(root, "", "");
+}
+
+// Removes the bench objects of all items.
+static void remove_objects(Rados &rados, const string &pool, const item_names &name2location) {
+    IoCtx ioctx;
+
+    if (rados.ioctx_create(pool.c_str(), ioctx) < 0)
+        throw "Failed to create ioctx";
+
+    for (const auto &p : name2location)
+        remove_objects(ioctx, p.second);
+
+    ioctx.close();
+}
+
+// Connects as client.admin with /etc/ceph/ceph.conf and the command line
+// overrides.
+static void connect_rados(Rados &rados, int argc, const char *argv[]) {
+    int err;
+    if ((err = rados.init("admin")) < 0) {
+        cerr << "Failed to init: " << strerror(-err) << endl;
+        throw "Failed to init";
+    }
+
+    if ((err = rados.conf_read_file("/etc/ceph/ceph.conf")) < 0) {
+        cerr << "Failed to read conf file: " << strerror(-err) << endl;
+        throw "Failed to read conf file";
+    }
+
+    if ((err = rados.conf_parse_argv(argc, argv)) < 0) {
+        cerr << "Failed to parse argv: " << strerror(-err) << endl;
+        throw "Failed to parse argv";
+    }
+
+    if ((err = rados.connect()) < 0) {
+        cerr << "Failed to connect: " << strerror(-err) << endl;
+        throw "Failed to connect";
+    }
+}
+
+// Object names to discover for every bench item.
+static size_t names_per_item(const bench_settings &settings) {
+    return (size_t) settings.threads * settings.objects_per_thread * settings.procs;
+}
+
+static unique_ptr <PayloadPool> create_payload(const bench_settings &settings) {
+    if (!settings.payload_file.empty())
+        return unique_ptr<PayloadPool>(new PayloadPool(settings.block_size, settings.payload_file));
+    return unique_ptr<PayloadPool>(new PayloadPool(settings.block_size,
+                                                   max<size_t>(16, (16 << 20) / settings.block_size),
+                                                   settings.compress_ratio, settings.dedup_ratio, settings.seed));
+}
+
+// Runs the bench of each item in `procs` forked worker processes, each with
+// its own cluster connection, to model many independent clients on one load
+// generator. The workers are forked before the parent connects or starts any
+// thread, and wait for jobs in a shared memory segment: the parent prefills
+// the objects of an item and publishes their names, the workers meet at a
+// start barrier in the segment, bench their slice of the names and leave
+// their histograms there for the parent to merge.
+class ProcessFanOut {
+public:
+    ProcessFanOut(const unique_ptr <bench_settings> &settings_, size_t names_per_item_,
+                  int argc_, const char *argv_[])
+            : settings(settings_), names_per_item(names_per_item_), argc(argc_), argv(argv_) {
+        size = sizeof(shared_state) + settings->procs * sizeof(worker_slot) + names_per_item * NAME_LEN;
+        void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            throw "Failed to map shared memory for worker processes";
+        state = new(mem) shared_state();
+        slots = reinterpret_cast<worker_slot *>(state + 1);
+        names = reinterpret_cast<char *>(slots + settings->procs);
+
+        pthread_mutexattr_t mattr;
+        pthread_mutexattr_init(&mattr);
+        pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+        pthread_mutex_init(&state->lock, &mattr);
+        pthread_condattr_t cattr;
+        pthread_condattr_init(&cattr);
+        pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+        pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+        pthread_cond_init(&state->cond, &cattr);
+
+        // Buffered output would be printed by every child again
+        cout.flush();
+        cerr.flush();
+        for (int i = 0; i < settings->procs; i++) {
+            const pid_t pid = fork();
+            if (pid < 0) {
+                stop_workers();
+                throw "Failed to fork a worker process";
+            }
+            if (pid == 0) {
+                int code = 0;
+                try {
+                    worker_main(i);
+                } catch (...) {
+                    code = 1;
+                }
+                cout.flush();
+                _exit(code);
+            }
+            workers.push_back(pid);
+        }
+    }
+
+    ~ProcessFanOut() {
+        stop_workers();
+        munmap(state, size);
+    }
+
+    bench_result run(const string &bench_item, const vector <string> &obj_names, client_ioctxs &ioctxs) {
+        if (obj_names.size() != names_per_item || bench_item.size() >= sizeof(state->bench_item))
+            throw "Wrong bench item for worker processes";
+        for (size_t i = 0; i < obj_names.size(); i++) {
+            if (obj_names[i].size() >= NAME_LEN)
+                throw "Object name too long for worker processes";
+            strcpy(names + i * NAME_LEN, obj_names[i].c_str());
+        }
+
+        prepare_objects(settings, obj_names, ioctxs);
+
+        pthread_mutex_lock(&state->lock);
+        strcpy(state->bench_item, bench_item.c_str());
+        state->arrived = 0;
+        state->start_failed = false;
+        state->finished = 0;
+        state->job++;
+        pthread_cond_broadcast(&state->cond);
+
+        // Keep an eye on the children: one that died never reports
+        try {
+            while (state->finished < (unsigned) settings->procs) {
+                timed_wait(1000);
+                abort_if_signalled();
+                for (const auto pid : workers)
+                    if (waitpid(pid, nullptr, WNOHANG) != 0)
+                        throw "A worker process died";
+            }
+        } catch (...) {
+            pthread_mutex_unlock(&state->lock);
+            throw;
+        }
+        pthread_mutex_unlock(&state->lock);
+
+        bench_result result;
+        result.secs = settings->secs;
+        result.clients.resize(settings->procs);
+        for (int i = 0; i < settings->procs; i++) {
+            const auto &slot = slots[i];
+            if (slot.failed) {
+                cerr << "Worker process " << i << " failed: " << slot.error << endl;
+                throw "Worker process failed";
+            }
+            for (int t = 0; t < OP_TYPES; t++) {
+                result.ops[t].merge_flat(slot.ops[t]);
+                result.corrected[t].merge_flat(slot.corrected[t]);
+                result.clients[i].merge_flat(slot.ops[t]);
+            }
+        }
+        return result;
+    }
+
+private:
+    static const size_t NAME_LEN = 32;
+
+    struct shared_state {
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        unsigned job;       // bumped by the parent for every bench item
+        bool quit;
+        char bench_item[64];
+        unsigned arrived;   // workers at the start barrier of this job
+        bool start_failed;
+        int64_t start_ns;   // steady_clock, which all processes share
+        unsigned finished;  // workers done with this job
+    };
+
+    struct worker_slot {
+        bool failed;
+        char error[128];
+        uint64_t ops[OP_TYPES][LatencyHistogram::FLAT_SIZE];
+        uint64_t corrected[OP_TYPES][LatencyHistogram::FLAT_SIZE];
+    };
+
+    // Waits on the shared condition with the lock held, up to `ms`.
+    void timed_wait(long ms) {
+        timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += ms / 1000;
+        deadline.tv_nsec += (ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&state->cond, &state->lock, &deadline);
+    }
+
+    // Start barrier of all worker processes. A worker that failed before
+    // starting still arrives, so that the others do not wait forever.
+    steady_clock::time_point rendezvous(bool failed) {
+        pthread_mutex_lock(&state->lock);
+        const unsigned job = state->job;
+        state->start_failed |= failed;
+        if (++state->arrived == (unsigned) settings->procs) {
+            state->start_ns = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+            pthread_cond_broadcast(&state->cond);
+        }
+        while (state->arrived < (unsigned) settings->procs && state->job == job && !state->quit)
+            timed_wait(1000);
+        const bool start_failed = state->start_failed || state->arrived < (unsigned) settings->procs;
+        const auto start = steady_clock::time_point(nanoseconds(state->start_ns));
+        pthread_mutex_unlock(&state->lock);
+        if (start_failed)
+            throw "Another worker process failed";
+        return start;
+    }
+
+    void worker_main(int index) {
+        // Every process runs `threads` threads on its own slice of the names,
+        // with its own seeds and its share of the target rate.
+        const unique_ptr <bench_settings> worker_settings(new bench_settings(*settings));
+        worker_settings->interval = 0;
+        worker_settings->rate = settings->rate / settings->procs;
+        worker_settings->seed = settings->seed + ((uint64_t) index * settings->threads << 32);
+        const size_t slice = names_per_item / settings->procs;
+
+        Rados rados;
+        bool connected = false;
+        client_ioctxs ioctxs(1);
+        unique_ptr <PayloadPool> payload;
+
+        unsigned seen = 0;
+        while (true) {
+            pthread_mutex_lock(&state->lock);
+            while (!state->quit && state->job == seen)
+                pthread_cond_wait(&state->cond, &state->lock);
+            const bool quit = state->quit;
+            seen = state->job;
+            const string bench_item = state->bench_item;
+            pthread_mutex_unlock(&state->lock);
+            if (quit)
+                break;
+
+            auto &slot = slots[index];
+            slot.failed = false;
+            bool arrived = false;
+            try {
+                if (!connected) {
+                    connect_rados(rados, argc, argv);
+                    connected = true;
+                    if (rados.ioctx_create(settings->pool.c_str(), ioctxs[0]) < 0)
+                        throw "Failed to create ioctx";
+                    payload = create_payload(*worker_settings);
+                }
+
+                vector <string> obj_names;
+                for (size_t i = index * slice; i < (index + 1) * slice; i++)
+                    obj_names.push_back(names + i * NAME_LEN);
+
+                RunControl control(worker_settings->threads, [&] {
+                    arrived = true;
+                    return rendezvous(false);
+                });
+                const auto result = do_bench(worker_settings, bench_item, obj_names, ioctxs, *payload,
+                                             false, &control, (size_t) index * settings->threads);
+                for (int t = 0; t < OP_TYPES; t++) {
+                    result.ops[t].flatten(slot.ops[t]);
+                    result.corrected[t].flatten(slot.corrected[t]);
+                }
+            } catch (const char *msg) {
+                report_failure(slot, msg);
+            } catch (const AbortException &) {
+                report_failure(slot, "aborted");
+            } catch (...) {
+                report_failure(slot, "unexpected error");
+            }
+
+            if (!arrived) {
+                try {
+                    rendezvous(true);
+                } catch (...) {
+                }
+            }
+
+            pthread_mutex_lock(&state->lock);
+            state->finished++;
+            pthread_cond_broadcast(&state->cond);
+            pthread_mutex_unlock(&state->lock);
+        }
+
+        ioctxs[0].close();
+        if (connected)
+            rados.shutdown();
+    }
+
+    static void report_failure(worker_slot &slot, const char *msg) {
+        slot.failed = true;
+        snprintf(slot.error, sizeof(slot.error), "%s", msg);
+    }
+
+    // Asks the workers to exit and reaps them, killing those that do not
+    // finish their current run in time.
+    void stop_workers() {
+        pthread_mutex_lock(&state->lock);
+        state->quit = true;
+        pthread_cond_broadcast(&state->cond);
+        pthread_mutex_unlock(&state->lock);
+
+        const auto deadline = steady_clock::now() + seconds(settings->warmup + settings->secs + 30);
+        for (const auto pid : workers) {
+            while (waitpid(pid, nullptr, WNOHANG) == 0) {
+                if (steady_clock::now() > deadline) {
+                    kill(pid, SIGKILL);
+                    waitpid(pid, nullptr, 0);
+                    break;
+                }
+                this_thread::sleep_for(milliseconds(100));
+            }
+        }
+        workers.clear();
+    }
+
+    const unique_ptr <bench_settings> &settings;
+    const size_t names_per_item;
+    const int argc;
+    const char **argv;
+
+    size_t size;
+    shared_state *state;
+    worker_slot *slots;
+    char *names;
+    vector <pid_t> workers;
+};
+
+// Returns the exit code: 0, or 3 when --compare found a regression.
+static int _main(int argc, const char *argv[]) {
     const unique_ptr <bench_settings> settings(new bench_settings);
 
     // Default settings
     settings->secs = 10;
+    settings->warmup = 0;
+    settings->interval = 1;
+    settings->ready_timeout = 60;
+    settings->reuse_pool = false;
+    settings->workload = "write";
+    settings->rw_mix = 0;
     settings->threads = 1;
+    settings->iodepth = 1;
+    settings->objects_per_thread = 16;
+    settings->clients = 1;
+    settings->procs = 1;
     settings->block_size = 4096;
     settings->object_size = 4096 * 1024;
+    settings->prefill_block = 4096 * 1024;
+    settings->write_mode = "overwrite";
+    settings->seed = 1;
+    settings->compress_ratio = 1;
+    settings->dedup_ratio = 0;
+    settings->rate = 0;
+    settings->slo_p99 = 0;
+    settings->search_max_qd = 256;
+    settings->parallel = 1;
+    settings->output_format = "json";
+    settings->threshold_p50 = 10;
+    settings->threshold_p99 = 20;
+    settings->threshold_iops = 10;
+    settings->interference = false;
+    settings->max_pairs = 0;
 
     int ai = 1;
     while (ai < argc) {
         if (argv[ai][0] == '-') {
             if(!strcmp(argv[ai], "-h")){
-                cout << "Usage: ./main [test-pool] [mode=host|osd] <host name|osd name> <-d secs> "
-                        << "<-t threads> <-b block> <-o object>" << endl;
-                return;
+                cout << "Usage: ./main [test-pool] [mode=host|osd] <host name|osd name> <-d secs> <--warmup secs> <-i report secs> "
+                        << "<-t threads> <-q iodepth> <--objects per thread> <--clients n> <--procs n> <--parallel items> <--interference> <--max-pairs n> <--rate iops> <--slo-p99 ms> <--search-max-qd n> <-w write|read-rand|read-seq> <--rw-mix read%> <--write-mode allocate|overwrite> <--prefill-block bytes> <--obj-dist pattern> <--off-dist pattern> <--seed n> <--compress-ratio r> <--dedup-ratio r> <--payload-file file> <-b block> <-o object> <--placement-cache file> <--ready-timeout secs> <--reuse-pool> <--output file> <--format json|csv> <--compare baseline.json> <--threshold-p50 %> <--threshold-p99 %> <--threshold-iops %>" << endl;
+                return 0;
             }
             if (!strcmp(argv[ai], "-d")) {
                 // duration
@@ -222,12 +1753,179 @@ static void _main(int argc, const char *argv[]) {
                 if (ai >= argc || sscanf(argv[ai], "%i", &settings->secs) != 1 ||
                     settings->secs < 1)
                     throw "Wrong duration";
+            } else if (!strcmp(argv[ai], "--warmup")) {
+                // seconds of load before measuring
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%i", &settings->warmup) != 1 ||
+                    settings->warmup < 0)
+                    throw "Wrong warmup duration";
+            } else if (!strcmp(argv[ai], "-i")) {
+                // report interval, 0 disables
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%i", &settings->interval) != 1 ||
+                    settings->interval < 0)
+                    throw "Wrong report interval";
             } else if (!strcmp(argv[ai], "-t")) {
                 // threads
                 ++ai;
                 if (ai >= argc || sscanf(argv[ai], "%i", &settings->threads) != 1 ||
                     settings->threads < 1)
                     throw "Wrong thread number";
+            } else if (!strcmp(argv[ai], "-q")) {
+                // aio ops in flight per thread
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%i", &settings->iodepth) != 1 ||
+                    settings->iodepth < 1)
+                    throw "Wrong iodepth";
+            } else if (!strcmp(argv[ai], "--clients")) {
+                // independent cluster connections the threads are spread over
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%i", &settings->clients) != 1 ||
+                    settings->clients < 1)
+                    throw "Wrong client number";
+            } else if (!strcmp(argv[ai], "--procs")) {
+                // worker processes, each running all threads with its own connection
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%i", &settings->procs) != 1 ||
+                    settings->procs < 1)
+                    throw "Wrong process number";
+            } else if (!strcmp(argv[ai], "--objects")) {
+                // working set of every thread, in objects
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%zu", &settings->objects_per_thread) != 1 ||
+                    settings->objects_per_thread < 1)
+                    throw "Wrong objects per thread";
+            } else if (!strcmp(argv[ai], "-w")) {
+                // workload
+                ++ai;
+                if (ai >= argc || (strcmp(argv[ai], "write") && strcmp(argv[ai], "read-rand") &&
+                                   strcmp(argv[ai], "read-seq")))
+                    throw "Wrong workload";
+                settings->workload = argv[ai];
+            } else if (!strcmp(argv[ai], "--placement-cache")) {
+                // file to keep discovered object names in between runs
+                ++ai;
+                if (ai >= argc || !*argv[ai])
+                    throw "Wrong placement cache file";
+                settings->placement_cache = argv[ai];
+            } else if (!strcmp(argv[ai], "--ready-timeout")) {
+                // how long to wait for the test pool PGs to become active+clean
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%i", &settings->ready_timeout) != 1 ||
+                    settings->ready_timeout < 1)
+                    throw "Wrong ready timeout";
+            } else if (!strcmp(argv[ai], "--reuse-pool")) {
+                // bench an existing size 1 pool instead of creating one
+                settings->reuse_pool = true;
+            } else if (!strcmp(argv[ai], "--write-mode")) {
+                // overwrite: writes go to prefilled objects, allocate: each to a block
+                // of a sparse object that was not written before in the run
+                ++ai;
+                if (ai >= argc || (strcmp(argv[ai], "allocate") && strcmp(argv[ai], "overwrite")))
+                    throw "Wrong write mode";
+                settings->write_mode = argv[ai];
+            } else if (!strcmp(argv[ai], "--prefill-block")) {
+                // size of the sequential prefill writes
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%zu", &settings->prefill_block) != 1 ||
+                    settings->prefill_block < 1)
+                    throw "Wrong prefill block size";
+            } else if (!strcmp(argv[ai], "--obj-dist") || !strcmp(argv[ai], "--off-dist")) {
+                // uniform | seq | stride:<step> | zipf:<theta> | hotspot:<space%>:<ops%>
+                const bool objects = !strcmp(argv[ai], "--obj-dist");
+                ++ai;
+                if (ai >= argc)
+                    throw "Wrong access pattern";
+                (objects ? settings->obj_pattern : settings->off_pattern) = AccessPattern::parse(argv[ai]);
+            } else if (!strcmp(argv[ai], "--seed")) {
+                // per-thread generators are seeded from this
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%" SCNu64, &settings->seed) != 1)
+                    throw "Wrong seed";
+            } else if (!strcmp(argv[ai], "--compress-ratio")) {
+                // original:compressed size of generated payloads, 1 is incompressible
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%lf", &settings->compress_ratio) != 1 ||
+                    settings->compress_ratio < 1)
+                    throw "Wrong compress ratio";
+            } else if (!strcmp(argv[ai], "--dedup-ratio")) {
+                // fraction of generated payload blocks that repeat another one
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%lf", &settings->dedup_ratio) != 1 ||
+                    settings->dedup_ratio < 0 || settings->dedup_ratio >= 1)
+                    throw "Wrong dedup ratio";
+            } else if (!strcmp(argv[ai], "--payload-file")) {
+                // write block_size slices of this file instead of generated data
+                ++ai;
+                if (ai >= argc || !*argv[ai])
+                    throw "Wrong payload file";
+                settings->payload_file = argv[ai];
+            } else if (!strcmp(argv[ai], "--rate")) {
+                // open loop: send this many ops per second per bench item
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%lf", &settings->rate) != 1 ||
+                    settings->rate <= 0)
+                    throw "Wrong rate";
+            } else if (!strcmp(argv[ai], "--parallel")) {
+                // bench items run at the same time, 0 means all of them
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%i", &settings->parallel) != 1 ||
+                    settings->parallel < 0)
+                    throw "Wrong parallel item number";
+            } else if (!strcmp(argv[ai], "--output")) {
+                // write per-item results to this file
+                ++ai;
+                if (ai >= argc || !*argv[ai])
+                    throw "Wrong output file";
+                settings->output = argv[ai];
+            } else if (!strcmp(argv[ai], "--format")) {
+                // format of the --output file
+                ++ai;
+                if (ai >= argc || (strcmp(argv[ai], "json") && strcmp(argv[ai], "csv")))
+                    throw "Wrong output format";
+                settings->output_format = argv[ai];
+            } else if (!strcmp(argv[ai], "--compare")) {
+                // --output JSON file of an earlier run to check for regressions
+                ++ai;
+                if (ai >= argc || !*argv[ai])
+                    throw "Wrong baseline file";
+                settings->compare = argv[ai];
+            } else if (!strcmp(argv[ai], "--threshold-p50") || !strcmp(argv[ai], "--threshold-p99") ||
+                       !strcmp(argv[ai], "--threshold-iops")) {
+                // percent of change that counts as a regression
+                double &threshold = !strcmp(argv[ai], "--threshold-p50") ? settings->threshold_p50 :
+                                    !strcmp(argv[ai], "--threshold-p99") ? settings->threshold_p99 :
+                                    settings->threshold_iops;
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%lf", &threshold) != 1 || threshold < 0)
+                    throw "Wrong regression threshold";
+            } else if (!strcmp(argv[ai], "--interference")) {
+                // bench items alone and in pairs and print the slowdown matrix
+                settings->interference = true;
+            } else if (!strcmp(argv[ai], "--max-pairs")) {
+                // sample this many pairs in interference mode, 0 means all
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%zu", &settings->max_pairs) != 1)
+                    throw "Wrong max pair number";
+            } else if (!strcmp(argv[ai], "--slo-p99")) {
+                // search for the max iops whose p99 latency in ms stays within this
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%lf", &settings->slo_p99) != 1 ||
+                    settings->slo_p99 <= 0)
+                    throw "Wrong p99 SLO";
+            } else if (!strcmp(argv[ai], "--search-max-qd")) {
+                // deepest iodepth the saturation search tries
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%i", &settings->search_max_qd) != 1 ||
+                    settings->search_max_qd < 1)
+                    throw "Wrong max search iodepth";
+            } else if (!strcmp(argv[ai], "--rw-mix")) {
+                // percentage of reads in a mixed workload
+                ++ai;
+                if (ai >= argc || sscanf(argv[ai], "%i", &settings->rw_mix) != 1 ||
+                    settings->rw_mix < 0 || settings->rw_mix > 100)
+                    throw "Wrong read/write mix";
+                settings->workload = "rw-mix";
             } else if (!strcmp(argv[ai], "-b")) {
                 // block size
                 ++ai;
@@ -258,115 +1956,318 @@ static void _main(int argc, const char *argv[]) {
         throw "Block size must not be greater than object size";
     }
 
-    if (settings->pool.empty() || settings->mode.empty()) {
-//        cerr << "Usage: " << argv[0]
-//             << " [poolname] [mode=host|osd] <specific item name to test>" << endl;
-        cout << "Usage: ./main [test-pool] [mode=host|osd] <host name|osd name> <-d secs> "
-             << "<-t threads> <-b block> <-o object>" << endl;
-        throw "Wrong cmdline";
+    if (settings->slo_p99 > 0 && settings->rate > 0) {
+        throw "Saturation search ramps iodepth and can't be combined with --rate";
     }
 
-    Rados rados;
-    int err;
-    if ((err = rados.init("admin")) < 0) {
-        cerr << "Failed to init: " << strerror(-err) << endl;
-        throw "Failed to init";
+    if (settings->slo_p99 > 0 && settings->parallel != 1) {
+        throw "Saturation search benches one item at a time";
     }
 
-    if ((err = rados.conf_read_file("/etc/ceph/ceph.conf")) < 0) {
-        cerr << "Failed to read conf file: " << strerror(-err) << endl;
-        throw "Failed to read conf file";
+    if (settings->interference && (settings->slo_p99 > 0 || settings->parallel != 1)) {
+        throw "Interference mode chooses the items to run together itself";
     }
 
-    if ((err = rados.conf_parse_argv(argc, argv)) < 0) {
-        cerr << "Failed to parse argv: " << strerror(-err) << endl;
-        throw "Failed to parse argv";
+    if ((!settings->output.empty() || !settings->compare.empty()) &&
+        (settings->interference || settings->slo_p99 > 0)) {
+        throw "Structured output and comparison are for plain bench runs only";
     }
 
-    if ((err = rados.connect()) < 0) {
-        cerr << "Failed to connect: " << strerror(-err) << endl;
-        throw "Failed to connect";
+    if (settings->clients > settings->threads) {
+        throw "Every client needs at least one thread";
     }
 
-    if ((err = rados.pool_create((settings->pool).c_str())) < 0) {
-        cerr << "Failed to create pool " << settings->pool << ": " << strerror(-err) << endl;
-        throw "Failed to create";
+    if (settings->procs > 1 && (settings->clients > 1 || settings->parallel != 1 ||
+                                settings->interference || settings->slo_p99 > 0)) {
+        throw "Worker processes run plain benches of one item at a time with one client each";
+    }
+
+    if (settings->pool.empty() || settings->mode.empty()) {
+//        cerr << "Usage: " << argv[0]
+//             << " [poolname] [mode=host|osd] <specific item name to test>" << endl;
+        cout << "Usage: ./main [test-pool] [mode=host|osd] <host name|osd name> <-d secs> <--warmup secs> <-i report secs> "
+             << "<-t threads> <-q iodepth> <--objects per thread> <--clients n> <--procs n> <--parallel items> <--interference> <--max-pairs n> <--rate iops> <--slo-p99 ms> <--search-max-qd n> <-w write|read-rand|read-seq> <--rw-mix read%> <--write-mode allocate|overwrite> <--prefill-block bytes> <--obj-dist pattern> <--off-dist pattern> <--seed n> <--compress-ratio r> <--dedup-ratio r> <--payload-file file> <-b block> <-o object> <--placement-cache file> <--ready-timeout secs> <--reuse-pool> <--output file> <--format json|csv> <--compare baseline.json> <--threshold-p50 %> <--threshold-p99 %> <--threshold-iops %>" << endl;
+        throw "Wrong cmdline";
     }
 
+    // Forked before anything connects or starts a thread
+    unique_ptr <ProcessFanOut> fanout;
+    if (settings->procs > 1)
+        fanout.reset(new ProcessFanOut(settings, names_per_item(*settings), argc, argv));
+
+    Rados rados;
+    connect_rados(rados, argc, argv);
+
+    int err;
+    if (settings->reuse_pool) {
+        if (rados.pool_lookup((settings->pool).c_str()) < 0) {
+            cerr << "Pool " << settings->pool << " does not exist" << endl;
+            throw "Failed to find pool to reuse";
+        }
+    } else {
+        if ((err = rados.pool_create((settings->pool).c_str())) < 0) {
+            cerr << "Failed to create pool " << settings->pool << ": " << strerror(-err) << endl;
+            throw "Failed to create";
+        }
+
+        // https://tracker.ceph.com/issues/24114
+        this_thread::sleep_for(milliseconds(100));
+    }
 
+    // benchitem -> [name1, name2] ||| i.e. "osd.2" => ["obj1", "obj2"]
+    item_names name2location;
+    bool regressed = false;
 
-    // https://tracker.ceph.com/issues/24114
-    this_thread::sleep_for(milliseconds(100));
+    // A reused pool is left in place, only our objects are removed.
+    auto cleanup = [&]() {
+        cout << "cleaning..." << endl;
+        if (settings->reuse_pool)
+            remove_objects(rados, settings->pool, name2location);
+        else
+            rados.pool_delete((settings->pool).c_str());
+        rados.shutdown();
+    };
 
     try {
         auto rados_utils = RadosUtils(&rados);
-        cout << "prepare test pool: " << settings->pool << endl;
-        rados_utils.set_pool_size_1(settings->pool);
-        this_thread::sleep_for(milliseconds(5000));
+        if (settings->reuse_pool) {
+            cout << "check test pool: " << settings->pool << endl;
+            const auto pool_info = rados_utils.get_pool_info(settings->pool);
+            if (pool_info.size != 1)
+                throw "It's required to have pool size 1";
+            cout << "pg_num: " << pool_info.pg_num << endl;
+            // A split or merge in progress moves objects under the bench
+            if (pool_info.pg_num != pool_info.pg_num_target || pool_info.pgp_num != pool_info.pg_num) {
+                cerr << "pg_num " << pool_info.pg_num << " (target " << pool_info.pg_num_target
+                     << "), pgp_num " << pool_info.pgp_num << endl;
+                throw "Pool pg_num is still changing, disable the autoscaler for the test pool";
+            }
+        } else {
+            cout << "prepare test pool: " << settings->pool << endl;
+            rados_utils.set_pool_size_1(settings->pool);
+        }
+        if (!rados_utils.wait_pool_ready(settings->pool, 1, seconds(settings->ready_timeout)))
+            throw "Test pool did not become active+clean in time";
         if (rados_utils.get_pool_size(settings->pool) != 1)
             throw "It's required to have pool size 1";
-        map<unsigned int, map<string, string>> osd2location;
+        const auto pool_info = rados_utils.get_pool_info(settings->pool);
+        const size_t names_per_item = ::names_per_item(*settings);
 
-        set <string> bench_items; // node1, node2 ||| osd.1, osd.2, osd.3
+        PlacementCache cache;
+        const bool cache_valid = !settings->placement_cache.empty() &&
+                                 cache.load(settings->placement_cache) &&
+                                 cache.pool_id == pool_info.id &&
+                                 cache.pg_num == pool_info.pg_num &&
+                                 cache.epoch == pool_info.epoch &&
+                                 cache.mode == settings->mode;
+
+        osd_locations osd2location;
 
-        for (const auto &osd : rados_utils.get_osds(settings->pool)) {
-            const auto &location = rados_utils.get_osd_location(osd);
-            // TODO: do not fill this map if specific_bench_item specified
-            osd2location[osd] = location;
+        if (cache_valid) {
+            osd2location = cache.osd2location;
+        } else {
+            for (const auto &osd : rados_utils.get_osds(settings->pool)) {
+                // TODO: do not fill this map if specific_bench_item specified
+                osd2location[osd] = rados_utils.get_osd_location(osd);
+            }
+        }
 
-            const auto &qwe = location.at(settings->mode);
+        set <string> bench_items; // node1, node2 ||| osd.1, osd.2, osd.3
+
+        for (const auto &p : osd2location) {
+            const auto &qwe = p.second.at(settings->mode);
             if (settings->specific_bench_item.empty() ||
                 qwe == settings->specific_bench_item) {
                 bench_items.insert(qwe);
             }
         }
 
-        // benchitem -> [name1, name2] ||| i.e. "osd.2" => ["obj1", "obj2"]
-        map <string, vector<string>> name2location;
-        unsigned int cnt = 0;
+        bool cache_hit = cache_valid;
+        for (const auto &bench_item : bench_items) {
+            if (!cache_hit)
+                break;
+            const auto it = cache.name2location.find(bench_item);
+            if (it == cache.name2location.end() || it->second.size() < names_per_item)
+                cache_hit = false;
+            else
+                name2location[bench_item].assign(it->second.begin(), it->second.begin() + names_per_item);
+        }
 
-        // for each bench_item find thread_count*16 names
-        // store every name in name2location = [bench_item, names, description]
-        cout << "Finding object names" << endl;
-        const string prefix = "bench_";
-        while (bench_items.size()) {
-            string name = prefix + to_string(++cnt);
+        if (cache_hit) {
+            cout << "Using cached object names from " << settings->placement_cache << endl;
+        } else {
+            name2location.clear();
+
+            // for each bench_item find threads * objects_per_thread names
+            cout << "Finding object names" << endl;
+            const auto b = steady_clock::now();
+            const string prefix = "bench_";
+
+            // Placement is computed locally from one PG table instead of one
+            // `osd map` mon command per candidate name.
+            const auto pg2primary = rados_utils.get_pg_primaries(settings->pool);
+            const ObjectPlacer placer(pool_info.pg_num, pool_info.object_hash, pg2primary);
+            if (placer.get_acting_primary(prefix + "1") !=
+                (int) rados_utils.get_obj_acting_primary(prefix + "1", settings->pool))
+                throw "Local object placement disagrees with the cluster";
+
+            // Candidate names are matched to items through their PG, so that
+            // millions of names cost one hash each: pg -> index of the wanted
+            // item, -1 if the PG is not benched, -2 if its primary is unknown.
+            const vector <string> wanted(bench_items.begin(), bench_items.end());
+            vector <vector<string> *> wanted_names;
+            for (const auto &bench_item : wanted) {
+                wanted_names.push_back(&name2location[bench_item]);
+                wanted_names.back()->reserve(names_per_item);
+            }
+            auto item_of_osd = [&](unsigned osd) {
+                const auto &bench_item = osd2location.at(osd).at(settings->mode);
+                const auto it = lower_bound(wanted.begin(), wanted.end(), bench_item);
+                return it != wanted.end() && *it == bench_item ? int(it - wanted.begin()) : -1;
+            };
+            vector<int> pg2item(pool_info.pg_num, -2);
+            vector<bool> has_pgs(wanted.size());
+            for (const auto &p : pg2primary) {
+                if (p.first >= pool_info.pg_num)
+                    continue;
+                pg2item[p.first] = item_of_osd(p.second);
+                if (pg2item[p.first] >= 0)
+                    has_pgs[pg2item[p.first]] = true;
+            }
+            if (count(pg2item.begin(), pg2item.end(), -2) == 0 &&
+                count(has_pgs.begin(), has_pgs.end(), false))
+                throw "A bench item is primary of no PG of the test pool";
+
+            // An item owning a single PG needs about pg_num candidates per
+            // name; far more means its PGs are never found, e.g. when their
+            // primary is unknown and the cluster maps no name to it.
+            const uint64_t max_candidates = 16 * (uint64_t) pool_info.pg_num * names_per_item + 1000;
+            size_t remaining = wanted.size();
+            for (uint64_t cnt = 1; remaining; cnt++) {
+                if (cnt > max_candidates) {
+                    for (size_t i = 0; i < wanted.size(); i++)
+                        if (wanted_names[i]->size() < names_per_item)
+                            cerr << "Could not find names for item " << wanted[i] << ": found "
+                                 << wanted_names[i]->size() << " of " << names_per_item << endl;
+                    throw "Could not find object names for every bench item";
+                }
+
+                string name = prefix + to_string(cnt);
+
+                int idx = pg2item[placer.get_pg(name)];
+                if (idx == -2)
+                    idx = item_of_osd(rados_utils.get_obj_acting_primary(name, settings->pool));
+                if (idx < 0)
+                    continue;
+
+                auto &names = *wanted_names[idx];
+                if (names.size() >= names_per_item)
+                    continue;
+                names.push_back(move(name));
+                if (names.size() == names_per_item)
+                    remaining--;
+            }
+            cout << "Found " << names_per_item * wanted.size() << " names in "
+                 << dur2sec(steady_clock::now() - b) << " s" << endl;
+
+            if (!settings->placement_cache.empty()) {
+                cache.pool_id = pool_info.id;
+                cache.pg_num = pool_info.pg_num;
+                cache.epoch = pool_info.epoch;
+                cache.mode = settings->mode;
+                cache.osd2location = osd2location;
+                cache.name2location = name2location;
+                cache.save(settings->placement_cache);
+            }
+        }
 
-            unsigned int osd = rados_utils.get_obj_acting_primary(name, settings->pool);
+        // Client 0 is the admin connection, the others are opened just for
+        // the bench and closed after their IoCtx.
+        vector <unique_ptr<Rados>> extra_clients;
+        client_ioctxs ioctxs(settings->clients);
+        for (int i = 0; i < settings->clients; i++) {
+            Rados *client = &rados;
+            if (i) {
+                extra_clients.emplace_back(new Rados);
+                client = extra_clients.back().get();
+                connect_rados(*client, argc, argv);
+            }
+            if (client->ioctx_create(settings->pool.c_str(), ioctxs[i]) < 0)
+                throw "Failed to create ioctx";
+        }
 
-            const auto &location = osd2location.at(osd);
-            const auto &bench_item = location.at(settings->mode);
-            if (!bench_items.count(bench_item))
-                continue;
+        const auto payload = create_payload(*settings);
 
-            auto &names = name2location[bench_item];
-            if (names.size() >= (unsigned) settings->threads * 16) {
-                bench_items.erase(bench_item);
-                continue;
+        if (settings->interference) {
+            bench_interference(settings, name2location, osd2location, ioctxs, *payload);
+        } else if (settings->slo_p99 > 0) {
+            for (const auto &p : name2location) {
+                const auto &bench_item = p.first;
+                const auto &obj_names = p.second;
+                cout << "Benching " << settings->mode << " " << bench_item << endl;
+                search_saturation(settings, bench_item, obj_names, ioctxs, *payload);
+            }
+        } else {
+            map<string, bench_result> results_by_item;
+
+            // Results of worker processes add up the threads of all of them
+            const unique_ptr <bench_settings> result_settings(new bench_settings(*settings));
+            result_settings->threads *= settings->procs;
+
+            // Items are benched `parallel` at a time, 0 means all at once.
+            const size_t batch_size = settings->parallel ? settings->parallel : name2location.size();
+            auto next_item = name2location.begin();
+            while (next_item != name2location.end()) {
+                vector<const item_names::value_type *> batch;
+                while (batch.size() < batch_size && next_item != name2location.end())
+                    batch.push_back(&*next_item++);
+
+                for (const auto item : batch)
+                    cout << "Benching " << settings->mode << " " << item->first << endl;
+                const auto results = fanout
+                                     ? vector<bench_result>(1, fanout->run(batch[0]->first, batch[0]->second, ioctxs))
+                                     : do_bench_concurrently(settings, batch, ioctxs, *payload);
+                for (size_t i = 0; i < batch.size(); i++) {
+                    if (batch.size() > 1)
+                        cout << "[Results of " << settings->mode << " " << batch[i]->first << "]" << endl;
+                    print_result(result_settings, results[i]);
+                    results_by_item[batch[i]->first] = results[i];
+                }
             }
 
-            names.push_back(name);
-        }
-
-        IoCtx ioctx;
+            if (!settings->output.empty()) {
+                BenchReport report("main");
+                report.add_environment("ceph_version", rados_utils.get_ceph_version());
+                report.add_environment("osdmap_epoch", to_string(pool_info.epoch));
+                report.add_environment("pool_id", to_string(pool_info.id));
+                settings->report_settings(report);
+                for (const auto &p : results_by_item)
+                    report.items.push_back(to_report_item(p.first, p.second));
+                if (!report.save(settings->output, settings->output_format)) {
+                    cerr << "Failed to write results to " << settings->output << endl;
+                    throw "Failed to write results";
+                }
+                cout << "Results written to " << settings->output << endl;
+            }
 
-        if (rados.ioctx_create(settings->pool.c_str(), ioctx) < 0)
-            throw "Failed to create ioctx";
+            if (!settings->compare.empty())
+                regressed = compare_with_baseline(settings, results_by_item);
 
-        for (const auto &p : name2location) {
-            const auto &bench_item = p.first;
-            const auto &obj_names = p.second;
-            cout << "Benching " << settings->mode << " " << bench_item << endl;
-            do_bench(settings, obj_names, ioctx);
+            if (results_by_item.size() > 2)
+                print_outliers(results_by_item);
+            if (settings->mode == "osd" && results_by_item.size() > 1)
+                print_crush_rollup(results_by_item, osd2location);
         }
 
-        ioctx.close();
+        for (auto &ioctx : ioctxs)
+            ioctx.close();
+        ioctxs.clear();
+        for (auto &client : extra_clients)
+            client->shutdown();
     }
     catch (...) {
         try{
-            cout << "cleaning..." << endl;
-            rados.pool_delete((settings->pool).c_str());
-            rados.shutdown();
+            cleanup();
         }
         catch(...){
             rados.watch_flush();
@@ -374,9 +2275,7 @@ static void _main(int argc, const char *argv[]) {
         throw;
     }
     try{
-        cout << "cleaning..." << endl;
-        rados.pool_delete((settings->pool).c_str());
-        rados.shutdown();
+        cleanup();
     }
     catch(...){
         rados.watch_flush();
@@ -387,13 +2286,17 @@ static void _main(int argc, const char *argv[]) {
     //rados_ioctx_destroy(io);
     //rados_shutdown(cluster);
 
-    return;
+    return regressed ? 3 : 0;
 }
 
 int main(int argc, const char *argv[]) {
     try {
         setup_signal_handlers();
-        _main(argc, argv);
+        const int ret = _main(argc, argv);
+        if (ret) {
+            cerr << "Performance regressed against the baseline" << endl;
+            return ret;
+        }
     }
     catch (const AbortException &msg) {
         cerr << "Test aborted" << endl;
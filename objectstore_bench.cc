@@ -16,6 +16,9 @@
 
 #include "common/strtol.h"
 #include "common/ceph_argparse.h"
+#include "common/version.h"
+
+#include "report.h"
 
 #define dout_context g_ceph_context
 #define dout_subsys ceph_subsys_filestore
@@ -35,7 +38,11 @@ static void usage() {
           "	 --threads\n"
           "	       number of threads to carry out this workload\n"
           "	 --multi-object\n"
-          "	       have each thread write to a separate object\n" << std::endl;
+          "	       have each thread write to a separate object\n"
+          "	 --output\n"
+          "	       write the results to this file\n"
+          "	 --format\n"
+          "	       json or csv, default json\n" << std::endl;
   cout << "[xattr_bench]" << std::endl;
   cout << "  --xattr_bench\n"
           "        open xattr_bench\n"
@@ -116,6 +123,29 @@ struct xattr_config {
         {}
 };
 
+// Latencies of one kind of op, recorded from the commit callbacks.
+struct op_stats {
+  std::mutex lock;
+  LatencyHistogram hist;
+
+  void record(std::chrono::steady_clock::duration d) {
+    std::lock_guard <std::mutex> guard(lock);
+    hist.record(d);
+  }
+};
+
+class C_RecordLatency : public Context {
+  op_stats *stats;
+  std::chrono::steady_clock::time_point queued;
+public:
+  C_RecordLatency(op_stats *stats, std::chrono::steady_clock::time_point queued)
+      : stats(stats), queued(queued) {}
+
+  void finish(int r) override {
+    stats->record(std::chrono::steady_clock::now() - queued);
+  }
+};
+
 class C_NotifyCond : public Context {
   std::mutex *mutex;
   std::condition_variable *cond;
@@ -131,9 +161,10 @@ public:
   }
 };
 
+// Write latencies are taken from the submission of each write to its commit.
 void osbench_worker(ObjectStore *os, const Config &cfg,
                     const coll_t cid, const ghobject_t oid,
-                    uint64_t starting_offset) {
+                    uint64_t starting_offset, op_stats *stats) {
   bufferlist data;
   data.append(buffer::create(cfg.block_size));
 
@@ -172,8 +203,14 @@ void osbench_worker(ObjectStore *os, const Config &cfg,
     std::condition_variable cond;
     bool done = false;
 
-    tls.back().register_on_commit(new C_NotifyCond(&mutex, &cond, &done));
-    os->queue_transactions(ch, tls);
+    // queue the writes one by one, so that each latency starts at its own
+    // submission rather than at the start of the cycle
+    for (size_t j = 0; j < tls.size(); ++j) {
+      tls[j].register_on_commit(new C_RecordLatency(stats, std::chrono::steady_clock::now()));
+      if (j == tls.size() - 1)
+        tls[j].register_on_commit(new C_NotifyCond(&mutex, &cond, &done));
+      os->queue_transaction(ch, std::move(tls[j]));
+    }
 
     std::unique_lock <std::mutex> lock(mutex);
     cond.wait(lock, [&done]() { return done; });
@@ -183,7 +220,7 @@ void osbench_worker(ObjectStore *os, const Config &cfg,
 
 void xattr_bench_worker(ObjectStore *os,
                         const coll_t cid, const ghobject_t oid,
-                        string key, bufferlist value, int nums) {
+                        string key, bufferlist value, int nums, op_stats *stats) {
   // get ch
   ObjectStore::CollectionHandle ch = os->open_collection(cid);
 
@@ -201,6 +238,7 @@ void xattr_bench_worker(ObjectStore *os,
     bool done = false;
 
     // set up the finisher
+    t->register_on_commit(new C_RecordLatency(stats, std::chrono::steady_clock::now()));
     t->register_on_commit(new C_NotifyCond(&mutex, &cond, &done));
 
     // queue
@@ -239,6 +277,9 @@ int main(int argc, const char *argv[]) {
   xattr_config xcfg;
   // xattr cfg switch;
   bool xattr_bench = false;
+  // structured results
+  std::string output;
+  std::string output_format = "json";
   // command-line arguments
   vector<const char *> args;
   argv_to_vec(argc, argv, args);
@@ -280,6 +321,14 @@ int main(int argc, const char *argv[]) {
       cfg.threads = atoi(val.c_str());
     } else if (ceph_argparse_flag(args, i, "--multi-object", (char *) nullptr)) {
       cfg.multi_object = true;
+    } else if (ceph_argparse_witharg(args, i, &val, "--output", (char *) nullptr)) {
+      output = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--format", (char *) nullptr)) {
+      if (val != "json" && val != "csv") {
+        derr << "error parsing format: " << val << dendl;
+        exit(1);
+      }
+      output_format = val;
     }
       // switch xattr-bench
     else if (ceph_argparse_flag(args, i, &val, "--xattr_bench", (char *) nullptr)) {
@@ -379,6 +428,12 @@ int main(int argc, const char *argv[]) {
     os->queue_transaction(ch, std::move(t));
   }
 
+  BenchReport report("ceph_objectstore_bench");
+  report.add_environment("ceph_version", ceph_version_to_str());
+  report.add_environment("objectstore", g_conf()->osd_objectstore);
+  report.add_environment("osd_data", g_conf()->osd_data);
+  op_stats stats;
+
   // create the objects
   std::vector <ghobject_t> oids;
   if (xattr_bench) {
@@ -435,7 +490,7 @@ int main(int argc, const char *argv[]) {
     auto t1 = high_resolution_clock::now();
     for (int i = 0; i < xcfg.threads; i++) {
       workers.emplace_back(xattr_bench_worker, os.get(), cid, oids[i],
-                           xcfg.key, bl, xcfg.nums);
+                           xcfg.key, bl, xcfg.nums, &stats);
     }
 
     for (auto &worker : workers)
@@ -453,6 +508,16 @@ int main(int argc, const char *argv[]) {
     std::cout << "threads: " << xcfg.threads << std::endl;
     std::cout << "***************************************" << std::endl;
 
+    report.add_setting("xattr_threads", xcfg.threads);
+    report.add_setting("nums", xcfg.nums);
+    report.add_setting("key_size", xcfg.key.length());
+    report.add_setting("value_size", bl.length());
+    ReportItem item;
+    item.name = "xattr_bench";
+    item.ops.push_back(ReportOp{"setattrs", stats.hist,
+                                1000000.0 * xcfg.nums * xcfg.threads / duration.count()});
+    report.items.push_back(item);
+
 
   } else {
     // run the worker threads
@@ -464,7 +529,7 @@ int main(int argc, const char *argv[]) {
     for (int i = 0; i < cfg.threads; i++) {
       const auto &oid = cfg.multi_object ? oids[i] : oids[0];
       workers.emplace_back(osbench_worker, os.get(), std::ref(cfg),
-                           cid, oid, i * cfg.size / cfg.threads);
+                           cid, oid, i * cfg.size / cfg.threads, &stats);
     }
     for (auto &worker : workers)
       worker.join();
@@ -478,6 +543,23 @@ int main(int argc, const char *argv[]) {
     dout(0) << "Wrote " << total << " in "
             << duration.count() << "us, at a rate of " << rate << "/s and "
             << iops << " iops" << dendl;
+
+    report.add_setting("size", cfg.size);
+    report.add_setting("block_size", cfg.block_size);
+    report.add_setting("repeats", cfg.repeats);
+    report.add_setting("threads", cfg.threads);
+    report.add_setting("multi_object", cfg.multi_object);
+    ReportItem item;
+    item.name = "objectstore_bench";
+    item.ops.push_back(ReportOp{"writes", stats.hist, (double) iops});
+    report.items.push_back(item);
+  }
+
+  if (!output.empty()) {
+    if (report.save(output, output_format))
+      dout(0) << "Results written to " << output << dendl;
+    else
+      derr << "Failed to write results to " << output << dendl;
   }
 
 clean_exit:
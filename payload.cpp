@@ -0,0 +1,93 @@
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "generators.h"
+#include "payload.h"
+
+using namespace std;
+using namespace librados;
+
+// Compressors see each run of random bytes followed by zeros; runs are short
+// enough to sit inside the window of snappy, lz4 and zstd alike.
+static const size_t compress_chunk = 512;
+
+PayloadPool::PayloadPool(size_t block_size, size_t count, double compress_ratio, double dedup_ratio,
+                         uint64_t seed)
+        : map_addr(nullptr), map_len(0) {
+    if (!count)
+        throw "Empty payload pool";
+    if (compress_ratio < 1)
+        throw "Compression ratio must be at least 1";
+    if (dedup_ratio < 0 || dedup_ratio >= 1)
+        throw "Dedup ratio must be in [0, 1)";
+
+    Rng rng(seed);
+    const size_t random_bytes = (size_t) ceil(compress_chunk / compress_ratio);
+    size_t unique = (size_t) ceil(count * (1 - dedup_ratio));
+    if (unique < 1)
+        unique = 1;
+
+    for (size_t i = 0; i < unique; i++) {
+        ceph::buffer::ptr block = ceph::buffer::create_page_aligned(block_size);
+        char *data = block.c_str();
+        memset(data, 0, block_size);
+        for (size_t off = 0; off < block_size; off += compress_chunk) {
+            const size_t len = min(random_bytes, block_size - off);
+            for (size_t j = 0; j < len; j += sizeof(uint64_t)) {
+                const uint64_t v = rng.next();
+                memcpy(data + off + j, &v, min(sizeof(v), len - j));
+            }
+        }
+        blocks.push_back(block);
+    }
+
+    // Duplicates share the data of a random unique block.
+    while (blocks.size() < count)
+        blocks.push_back(blocks[rng.below(unique)]);
+
+    // Spread the duplicates over the cycle instead of leaving them at the end.
+    for (size_t i = blocks.size() - 1; i > 0; i--)
+        swap(blocks[i], blocks[rng.below(i + 1)]);
+}
+
+PayloadPool::PayloadPool(size_t block_size, const string &path) : map_addr(nullptr), map_len(0) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw "Failed to open payload file";
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < block_size) {
+        close(fd);
+        throw "Payload file is smaller than block size";
+    }
+
+    map_len = st.st_size;
+    map_addr = mmap(nullptr, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map_addr == MAP_FAILED) {
+        map_addr = nullptr;
+        throw "Failed to mmap payload file";
+    }
+    madvise(map_addr, map_len, MADV_WILLNEED);
+
+    char *data = static_cast<char *>(map_addr);
+    for (size_t off = 0; off + block_size <= map_len; off += block_size)
+        blocks.push_back(ceph::buffer::create_static(block_size, data + off));
+}
+
+PayloadPool::~PayloadPool() {
+    blocks.clear();
+    if (map_addr)
+        munmap(map_addr, map_len);
+}
+
+vector <bufferlist> PayloadPool::get_blocks() const {
+    vector <bufferlist> res(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++)
+        res[i].append(blocks[i]);
+    return res;
+}
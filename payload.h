@@ -0,0 +1,37 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <librados.hpp>
+
+// Write payloads of one block size, generated once and then cycled through
+// by the bench threads, so no op allocates or fills a buffer.
+class PayloadPool {
+public:
+    // `count` blocks that compress about compress_ratio:1 each, of which
+    // dedup_ratio are copies of other blocks in the pool.
+    PayloadPool(size_t block_size, size_t count, double compress_ratio, double dedup_ratio, uint64_t seed);
+
+    // Consecutive block_size slices of a sample file, mapped read-only.
+    PayloadPool(size_t block_size, const std::string &path);
+
+    ~PayloadPool();
+
+    PayloadPool(const PayloadPool &) = delete;
+
+    PayloadPool &operator=(const PayloadPool &) = delete;
+
+    size_t size() const { return blocks.size(); }
+
+    // Every thread takes its own bufferlists, they share the data.
+    std::vector <librados::bufferlist> get_blocks() const;
+
+private:
+    std::vector <ceph::buffer::ptr> blocks;
+    void *map_addr;
+    size_t map_len;
+};
+
+#endif
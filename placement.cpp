@@ -0,0 +1,208 @@
+#include <exception>
+#include <fstream>
+#include <json/json.h>
+
+#include "placement.h"
+
+using namespace std;
+
+uint32_t ceph_str_hash_linux(const char *str, unsigned length) {
+    uint32_t hash = 0;
+
+    while (length--) {
+        unsigned char c = *str++;
+        hash = (hash + (c << 4) + (c >> 4)) * 11;
+    }
+    return hash;
+}
+
+// Robert Jenkins' hash function, see http://burtleburtle.net/bob/hash/evahash.html
+#define mix(a, b, c)                            \
+    do {                                        \
+        a = a - b;  a = a - c;  a = a ^ (c >> 13); \
+        b = b - c;  b = b - a;  b = b ^ (a << 8);  \
+        c = c - a;  c = c - b;  c = c ^ (b >> 13); \
+        a = a - b;  a = a - c;  a = a ^ (c >> 12); \
+        b = b - c;  b = b - a;  b = b ^ (a << 16); \
+        c = c - a;  c = c - b;  c = c ^ (b >> 5);  \
+        a = a - b;  a = a - c;  a = a ^ (c >> 3);  \
+        b = b - c;  b = b - a;  b = b ^ (a << 10); \
+        c = c - a;  c = c - b;  c = c ^ (b >> 15); \
+    } while (0)
+
+uint32_t ceph_str_hash_rjenkins(const char *str, unsigned length) {
+    const unsigned char *k = (const unsigned char *) str;
+    uint32_t a, b, c;
+    uint32_t len = length;
+
+    a = 0x9e3779b9;
+    b = a;
+    c = 0;
+
+    while (len >= 12) {
+        a = a + (k[0] + ((uint32_t) k[1] << 8) + ((uint32_t) k[2] << 16) + ((uint32_t) k[3] << 24));
+        b = b + (k[4] + ((uint32_t) k[5] << 8) + ((uint32_t) k[6] << 16) + ((uint32_t) k[7] << 24));
+        c = c + (k[8] + ((uint32_t) k[9] << 8) + ((uint32_t) k[10] << 16) + ((uint32_t) k[11] << 24));
+        mix(a, b, c);
+        k = k + 12;
+        len = len - 12;
+    }
+
+    // the last 11 bytes, all cases fall through
+    c = c + length;
+    switch (len) {
+        case 11:
+            c = c + ((uint32_t) k[10] << 24);
+            /* fallthrough */
+        case 10:
+            c = c + ((uint32_t) k[9] << 16);
+            /* fallthrough */
+        case 9:
+            c = c + ((uint32_t) k[8] << 8);
+            /* fallthrough */
+        case 8:
+            b = b + ((uint32_t) k[7] << 24);
+            /* fallthrough */
+        case 7:
+            b = b + ((uint32_t) k[6] << 16);
+            /* fallthrough */
+        case 6:
+            b = b + ((uint32_t) k[5] << 8);
+            /* fallthrough */
+        case 5:
+            b = b + k[4];
+            /* fallthrough */
+        case 4:
+            a = a + ((uint32_t) k[3] << 24);
+            /* fallthrough */
+        case 3:
+            a = a + ((uint32_t) k[2] << 16);
+            /* fallthrough */
+        case 2:
+            a = a + ((uint32_t) k[1] << 8);
+            /* fallthrough */
+        case 1:
+            a = a + k[0];
+    }
+    mix(a, b, c);
+
+    return c;
+}
+
+#undef mix
+
+ObjectPlacer::ObjectPlacer(unsigned pg_num_, unsigned object_hash_, const map<unsigned, unsigned> &pg2primary_)
+        : pg_num(pg_num_), pg_num_mask(0), object_hash(object_hash_), pg2primary(pg2primary_) {
+    if (!pg_num)
+        throw "Pool has no PGs";
+    if (object_hash != CEPH_STR_HASH_LINUX && object_hash != CEPH_STR_HASH_RJENKINS)
+        throw "Unknown pool object hash";
+
+    // (1 << cbits(pg_num - 1)) - 1
+    while (pg_num_mask < pg_num - 1)
+        pg_num_mask = (pg_num_mask << 1) | 1;
+}
+
+unsigned ObjectPlacer::get_pg(const string &name) const {
+    const uint32_t ps = object_hash == CEPH_STR_HASH_LINUX
+                        ? ceph_str_hash_linux(name.data(), name.size())
+                        : ceph_str_hash_rjenkins(name.data(), name.size());
+
+    // ceph_stable_mod()
+    if ((ps & pg_num_mask) < pg_num)
+        return ps & pg_num_mask;
+    return ps & (pg_num_mask >> 1);
+}
+
+int ObjectPlacer::get_acting_primary(const string &name) const {
+    const auto it = pg2primary.find(get_pg(name));
+    if (it == pg2primary.end())
+        return -1;
+    return it->second;
+}
+
+// Generated names are kept as their number, which makes caches of millions
+// of names several times smaller.
+static const string NAME_PREFIX = "bench_";
+
+static Json::Value compact_name(const string &name) {
+    if (name.compare(0, NAME_PREFIX.size(), NAME_PREFIX) || name.size() == NAME_PREFIX.size() ||
+        name.size() > NAME_PREFIX.size() + 19 || name[NAME_PREFIX.size()] == '0' ||
+        name.find_first_not_of("0123456789", NAME_PREFIX.size()) != string::npos)
+        return name;
+    return Json::UInt64(stoull(name.substr(NAME_PREFIX.size())));
+}
+
+bool PlacementCache::load(const string &path) {
+    ifstream infile(path);
+    if (!infile)
+        return false;
+
+    Json::Value root;
+    Json::Reader reader(Json::Features::strictMode());
+    if (!reader.parse(infile, root) || !root.isObject())
+        return false;
+
+    // A damaged or hand-edited file is treated as missing and rebuilt
+    try {
+        pool_id = root["pool_id"].asInt64();
+        pg_num = root["pg_num"].asUInt();
+        epoch = root["epoch"].asUInt();
+        mode = root["mode"].asString();
+
+        osd2location.clear();
+        const auto &locations = root["osd_location"];
+        for (auto it = locations.begin(); it != locations.end(); ++it) {
+            auto &location = osd2location[stoul(it.name())];
+            for (auto lit = it->begin(); lit != it->end(); ++lit)
+                location[lit.name()] = lit->asString();
+        }
+
+        name2location.clear();
+        const auto &names = root["names"];
+        for (auto it = names.begin(); it != names.end(); ++it) {
+            auto &item = name2location[it.name()];
+            item.reserve(it->size());
+            for (const auto &name : *it)
+                item.push_back(name.isString() ? name.asString() : NAME_PREFIX + to_string(name.asUInt64()));
+        }
+    } catch (const exception &) {
+        osd2location.clear();
+        name2location.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void PlacementCache::save(const string &path) const {
+    Json::Value root(Json::objectValue);
+    root["pool_id"] = Json::Int64(pool_id);
+    root["pg_num"] = pg_num;
+    root["epoch"] = epoch;
+    root["mode"] = mode;
+
+    Json::Value &locations = root["osd_location"] = Json::Value(Json::objectValue);
+    for (const auto &p : osd2location) {
+        Json::Value &location = locations[to_string(p.first)] = Json::Value(Json::objectValue);
+        for (const auto &l : p.second)
+            location[l.first] = l.second;
+    }
+
+    Json::Value &names = root["names"] = Json::Value(Json::objectValue);
+    for (const auto &p : name2location) {
+        Json::Value &item = names[p.first] = Json::Value(Json::arrayValue);
+        for (const auto &name : p.second)
+            item.append(compact_name(name));
+    }
+
+    // Write aside and rename, so that concurrent runs never see half a file.
+    const string tmp = path + ".tmp";
+    ofstream outfile(tmp, ios::out | ios::trunc);
+    outfile << Json::FastWriter().write(root);
+    outfile.close();
+    if (outfile.fail() || rename(tmp.c_str(), path.c_str()) < 0) {
+        remove(tmp.c_str());
+        throw "Failed to save placement cache";
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Object name hashes as implemented in Ceph's common/ceph_hash.cc.
+enum {
+    CEPH_STR_HASH_LINUX = 0x1,
+    CEPH_STR_HASH_RJENKINS = 0x2,
+};
+
+uint32_t ceph_str_hash_linux(const char *str, unsigned length);
+
+uint32_t ceph_str_hash_rjenkins(const char *str, unsigned length);
+
+// Maps object names of one pool to acting primaries without asking the mons:
+// the PG is computed the way the OSD client does it (name hash, then
+// stable_mod on pg_num), and the primary is looked up in a PG table obtained
+// once from `pg ls-by-pool`. Objects are assumed to have no namespace or key.
+class ObjectPlacer {
+public:
+    ObjectPlacer(unsigned pg_num, unsigned object_hash, const std::map<unsigned, unsigned> &pg2primary);
+
+    unsigned get_pg(const std::string &name) const;
+
+    // Returns -1 if the PG has no known acting primary.
+    int get_acting_primary(const std::string &name) const;
+
+private:
+    unsigned pg_num;
+    unsigned pg_num_mask;
+    unsigned object_hash;
+    std::map<unsigned, unsigned> pg2primary;
+};
+
+// osd id -> crush location, as returned by RadosUtils::get_osd_location
+typedef std::map<unsigned int, std::map<std::string, std::string>> osd_locations;
+
+// bench item -> object names placed on it
+typedef std::map<std::string, std::vector<std::string>> item_names;
+
+// On-disk copy of a finished object name discovery. It is only valid for the
+// pool, pg_num and osdmap epoch it was computed at.
+struct PlacementCache {
+    int64_t pool_id;
+    unsigned pg_num;
+    unsigned epoch;
+    std::string mode;
+    osd_locations osd2location;
+    item_names name2location;
+
+    // Returns false if there is no usable cache file.
+    bool load(const std::string &path);
+
+    void save(const std::string &path) const;
+};
+
+#endif
@@ -1,7 +1,10 @@
 #include <string>
+#include <thread>
 
 #include <json/json.h>
 
+#include "mysignals.h"
+
 
 #include "radosutil.h"
 
@@ -78,6 +81,64 @@ set<unsigned int> RadosUtils::get_osds(const string &pool) {
     return osds;
 }
 
+map<unsigned int, unsigned int> RadosUtils::get_pg_primaries(const string &pool) {
+    Json::Value cmd(Json::objectValue);
+    cmd["prefix"] = "pg ls-by-pool";
+    cmd["poolstr"] = pool;
+
+    const auto &&pgs = do_mon_command(cmd);
+
+    map<unsigned int, unsigned int> primaries;
+
+    for (const auto &pg : pgs["pg_stats"]) {
+        const auto &primary = pg["acting_primary"];
+        if (!primary.isNumeric() || primary < 0)
+            continue;
+
+        // "<pool id>.<pg seed in hex>"
+        const auto &pgid = pg["pgid"].asString();
+        const auto dot = pgid.find('.');
+        if (dot == string::npos)
+            throw "Failed to parse pgid";
+        primaries[stoul(pgid.substr(dot + 1), nullptr, 16)] = primary.asUInt();
+    }
+
+    return primaries;
+}
+
+PoolInfo RadosUtils::get_pool_info(const string &pool) {
+    Json::Value cmd(Json::objectValue);
+    cmd["prefix"] = "osd dump";
+
+    const auto &&osdmap = do_mon_command(cmd);
+
+    for (const auto &p : osdmap["pools"]) {
+        if (p["pool_name"].asString() != pool)
+            continue;
+
+        PoolInfo info;
+        info.id = p["pool"].asInt64();
+        info.epoch = osdmap["epoch"].asUInt();
+        info.size = p["size"].asUInt();
+        info.pg_num = p["pg_num"].asUInt();
+        // Releases before Nautilus have no targets and change pg_num at once
+        info.pg_num_target = p.isMember("pg_num_target") ? p["pg_num_target"].asUInt() : info.pg_num;
+        info.pgp_num = p["pg_placement_num"].asUInt();
+        info.object_hash = p["object_hash"].asUInt();
+        return info;
+    }
+
+    throw "Pool not found in osdmap";
+}
+
+string RadosUtils::get_ceph_version() {
+    Json::Value cmd(Json::objectValue);
+    cmd["prefix"] = "version";
+
+    const auto &&v = do_mon_command(cmd);
+    return v["version"].asString();
+}
+
 unsigned int RadosUtils::get_pool_size(const string &pool) {
     Json::Value cmd(Json::objectValue);
     cmd["prefix"] = "osd pool get";
@@ -108,6 +169,42 @@ unsigned int RadosUtils::set_pool_size_1(const string &pool) {
     return 0;
 }
 
+bool RadosUtils::wait_pool_ready(const string &pool, unsigned int size, chrono::milliseconds timeout) {
+    const auto deadline = chrono::steady_clock::now() + timeout;
+    unsigned int last_epoch = 0;
+
+    for (;;) {
+        abort_if_signalled();
+
+        const auto info = get_pool_info(pool);
+        bool ready = info.size == size && info.epoch == last_epoch;
+        last_epoch = info.epoch;
+
+        if (ready) {
+            Json::Value cmd(Json::objectValue);
+            cmd["prefix"] = "pg ls-by-pool";
+            cmd["poolstr"] = pool;
+
+            const auto &&pgs = do_mon_command(cmd);
+
+            unsigned int clean = 0;
+            for (const auto &pg : pgs["pg_stats"]) {
+                if (pg["state"].asString() == "active+clean" && pg["acting"].size() == size)
+                    clean++;
+            }
+            ready = clean == info.pg_num;
+        }
+
+        if (ready)
+            return true;
+
+        if (chrono::steady_clock::now() >= deadline)
+            return false;
+
+        this_thread::sleep_for(chrono::milliseconds(200));
+    }
+}
+
 Json::Value RadosUtils::do_mon_command(Json::Value &cmd) {
     int err;
     bufferlist outbl;
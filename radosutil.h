@@ -1,3 +1,4 @@
+#include <chrono>
 #include <exception>
 #include <map>
 #include <memory>
@@ -19,6 +20,16 @@ namespace Json {
 //class Rados;
 //}
 
+struct PoolInfo {
+    int64_t id;
+    unsigned epoch; // osdmap epoch the info was taken from
+    unsigned size;
+    unsigned pg_num;
+    unsigned pg_num_target; // differs from pg_num while PGs split or merge
+    unsigned pgp_num;
+    unsigned object_hash;
+};
+
 class RadosUtils {
 public:
     explicit RadosUtils(librados::Rados *rados_);
@@ -30,10 +41,23 @@ public:
 
     std::set<unsigned int> get_osds(const std::string &pool);
 
+    // pg seed -> acting primary
+    std::map<unsigned int, unsigned int> get_pg_primaries(const std::string &pool);
+
+    PoolInfo get_pool_info(const std::string &pool);
+
+    // Version string reported by the monitors, e.g. "ceph version 14.2.22 (...)"
+    std::string get_ceph_version();
+
     unsigned int get_pool_size(const std::string &pool);
 
     unsigned int set_pool_size_1(const std::string &pool);
 
+    // Polls until the osdmap has the pool at `size` and all its PGs are
+    // active+clean with `size` acting OSDs, at the same osdmap epoch for two
+    // polls in a row. Returns false on timeout.
+    bool wait_pool_ready(const std::string &pool, unsigned int size, std::chrono::milliseconds timeout);
+
 private:
     Json::Value do_mon_command(Json::Value &cmd);
 
@@ -0,0 +1,251 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "histogram.h"
+
+// Structured results shared by main and ceph_objectstore_bench. Header only
+// and without a JSON library, so that it builds in the Ceph tree as well.
+//
+// JSON schema "ceph-bench-result/1":
+//   {"schema", "tool", "environment": {key: string},
+//    "settings": {key: string|number|bool},
+//    "items": [{"name", "ops": [{"op", "count", "iops", "min_ms", "mean_ms",
+//                                "max_ms", "percentiles_ms": {"50": ..},
+//                                "buckets": [[lower_ns, upper_ns, count]]}],
+//               "series": [{"t", "op", "count", "iops", "mib_s",
+//                           "p50_ms", "p99_ms"}]}]}
+//
+// CSV has one "summary" row per item and op, and one "interval" row per
+// item, op and report interval, under a header of "# key=value" lines.
+
+static const char *const REPORT_SCHEMA = "ceph-bench-result/1";
+
+static const double REPORT_PERCENTILES[] = {50, 90, 99, 99.9, 99.99};
+
+struct ReportInterval {
+    double t;   // seconds since the start of the item
+    std::string op;
+    uint64_t count;
+    double iops;
+    double mib_s;
+    uint64_t p50;
+    uint64_t p99;
+};
+
+struct ReportOp {
+    std::string op;
+    LatencyHistogram hist;
+    double iops;
+};
+
+struct ReportItem {
+    std::string name;
+    std::vector <ReportOp> ops;
+    std::vector <ReportInterval> series;
+};
+
+class BenchReport {
+public:
+    explicit BenchReport(const std::string &tool_) : tool(tool_) {
+        char host[256] = "";
+        gethostname(host, sizeof(host) - 1);
+        add_environment("client_host", host);
+
+        char now[32];
+        const time_t t = time(nullptr);
+        struct tm tm;
+        strftime(now, sizeof(now), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&t, &tm));
+        add_environment("timestamp", now);
+    }
+
+    void add_environment(const std::string &key, const std::string &value) {
+        environment.push_back(std::make_pair(key, value));
+    }
+
+    void add_setting(const std::string &key, const std::string &value) {
+        settings.push_back(setting{key, value, true});
+    }
+
+    void add_setting(const std::string &key, const char *value) {
+        add_setting(key, std::string(value));
+    }
+
+    // Integer settings such as seeds are written exactly, not as doubles.
+    void add_setting(const std::string &key, int64_t value) {
+        settings.push_back(setting{key, std::to_string(value), false});
+    }
+
+    void add_setting(const std::string &key, uint64_t value) {
+        settings.push_back(setting{key, std::to_string(value), false});
+    }
+
+    template<class T>
+    typename std::enable_if<std::is_integral<T>::value>::type add_setting(const std::string &key, T value) {
+        add_setting(key, static_cast<typename std::conditional<std::is_signed<T>::value,
+                int64_t, uint64_t>::type>(value));
+    }
+
+    void add_setting(const std::string &key, bool value) {
+        settings.push_back(setting{key, value ? "true" : "false", false});
+    }
+
+    void add_setting(const std::string &key, double value) {
+        settings.push_back(setting{key, number(value), false});
+    }
+
+    std::vector <ReportItem> items;
+
+    void write_json(std::ostream &out) const {
+        out << "{\"schema\": " << quote(REPORT_SCHEMA) << ", \"tool\": " << quote(tool) << ",\n";
+        out << " \"environment\": {";
+        for (size_t i = 0; i < environment.size(); i++)
+            out << (i ? ", " : "") << quote(environment[i].first) << ": " << quote(environment[i].second);
+        out << "},\n \"settings\": {";
+        for (size_t i = 0; i < settings.size(); i++)
+            out << (i ? ", " : "") << quote(settings[i].key) << ": "
+                << (settings[i].text ? quote(settings[i].value) : settings[i].value);
+        out << "},\n \"items\": [";
+        for (size_t i = 0; i < items.size(); i++) {
+            const auto &item = items[i];
+            out << (i ? ",\n" : "\n") << "  {\"name\": " << quote(item.name) << ", \"ops\": [";
+            for (size_t j = 0; j < item.ops.size(); j++) {
+                const auto &op = item.ops[j];
+                const auto &hist = op.hist;
+                out << (j ? ",\n" : "\n") << "    {\"op\": " << quote(op.op)
+                    << ", \"count\": " << hist.count() << ", \"iops\": " << number(op.iops)
+                    << ", \"min_ms\": " << msec(hist.min()) << ", \"mean_ms\": " << number(hist.mean() / 1e6)
+                    << ", \"max_ms\": " << msec(hist.max()) << ", \"percentiles_ms\": {";
+                for (size_t p = 0; p < sizeof(REPORT_PERCENTILES) / sizeof(REPORT_PERCENTILES[0]); p++)
+                    out << (p ? ", " : "") << quote(number(REPORT_PERCENTILES[p]))
+                        << ": " << msec(hist.percentile(REPORT_PERCENTILES[p]));
+                out << "},\n     \"buckets\": [";
+                bool first = true;
+                for (size_t b = 0; b < LatencyHistogram::BUCKETS; b++) {
+                    if (!hist.count_at(b))
+                        continue;
+                    out << (first ? "" : ", ") << "[" << LatencyHistogram::bucket_lower(b) << ", "
+                        << LatencyHistogram::bucket_upper(b) << ", " << hist.count_at(b) << "]";
+                    first = false;
+                }
+                out << "]}";
+            }
+            out << "],\n   \"series\": [";
+            for (size_t j = 0; j < item.series.size(); j++) {
+                const auto &s = item.series[j];
+                out << (j ? ",\n" : "\n") << "    {\"t\": " << number(s.t) << ", \"op\": " << quote(s.op)
+                    << ", \"count\": " << s.count << ", \"iops\": " << number(s.iops)
+                    << ", \"mib_s\": " << number(s.mib_s) << ", \"p50_ms\": " << msec(s.p50)
+                    << ", \"p99_ms\": " << msec(s.p99) << "}";
+            }
+            out << "]}";
+        }
+        out << "]}" << std::endl;
+    }
+
+    void write_csv(std::ostream &out) const {
+        out << "# schema=" << REPORT_SCHEMA << "\n# tool=" << tool << "\n";
+        for (const auto &p : environment)
+            out << "# " << p.first << "=" << p.second << "\n";
+        for (const auto &p : settings)
+            out << "# " << p.key << "=" << p.value << "\n";
+
+        out << "record,item,op,t,count,iops,mib_s,min_ms,mean_ms,max_ms";
+        for (const auto pct : REPORT_PERCENTILES)
+            out << ",p" << number(pct) << "_ms";
+        out << "\n";
+
+        for (const auto &item : items) {
+            for (const auto &op : item.ops) {
+                const auto &hist = op.hist;
+                out << "summary," << csv(item.name) << "," << csv(op.op) << ",," << hist.count() << ","
+                    << number(op.iops) << ",," << msec(hist.min()) << "," << number(hist.mean() / 1e6)
+                    << "," << msec(hist.max());
+                for (const auto pct : REPORT_PERCENTILES)
+                    out << "," << msec(hist.percentile(pct));
+                out << "\n";
+            }
+            for (const auto &s : item.series) {
+                out << "interval," << csv(item.name) << "," << csv(s.op) << "," << number(s.t) << ","
+                    << s.count << "," << number(s.iops) << "," << number(s.mib_s) << ",,,,"
+                    << msec(s.p50) << ",," << msec(s.p99) << ",,\n";
+            }
+        }
+        out.flush();
+    }
+
+    // Writes the report to `path` as "json" or "csv". Returns false if the
+    // file could not be written.
+    bool save(const std::string &path, const std::string &format) const {
+        std::ofstream out(path, std::ios::out | std::ios::trunc);
+        if (!out)
+            return false;
+        if (format == "csv")
+            write_csv(out);
+        else
+            write_json(out);
+        out.close();
+        return !out.fail();
+    }
+
+private:
+    static std::string number(double v) {
+        std::ostringstream s;
+        s.precision(10);
+        s << v;
+        return s.str();
+    }
+
+    static std::string msec(uint64_t ns) {
+        return number(ns / 1e6);
+    }
+
+    static std::string quote(const std::string &s) {
+        std::string r = "\"";
+        for (const char c : s) {
+            if (c == '"' || c == '\\') {
+                r += '\\';
+                r += c;
+            } else if ((unsigned char) c < 0x20) {
+                char esc[8];
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                r += esc;
+            } else {
+                r += c;
+            }
+        }
+        return r + "\"";
+    }
+
+    static std::string csv(const std::string &s) {
+        if (s.find_first_of(",\"\n") == std::string::npos)
+            return s;
+        std::string r = "\"";
+        for (const char c : s)
+            r += c == '"' ? std::string("\"\"") : std::string(1, c);
+        return r + "\"";
+    }
+
+    struct setting {
+        std::string key;
+        std::string value;
+        bool text; // quoted in JSON
+    };
+
+    std::string tool;
+    std::vector <std::pair<std::string, std::string>> environment;
+    std::vector <setting> settings;
+};
+
+#endif